@@ -10,40 +10,296 @@
 
 #include "flash_emulateEEprom.h"
 
+/* 索引结构中没有写入的成员(全1) */
+#define INDEX_FIELD_EMPTY  ((ee_size_t)0xFFFFFFFF)
+
 /* 数据状态 */
-#define DATA_EMPTY         ((ee_uint16)0xFFFF)
-#define DATA_INVALID       ((ee_uint16)0x00FF)
-#define DATA_HALFVALID     ((ee_uint16)0x000F)
-#define DATA_VALID         ((ee_uint16)0x0000)
+#define DATA_EMPTY         INDEX_FIELD_EMPTY
+#define DATA_INVALID       ((ee_size_t)0x00FF)
+#define DATA_HALFVALID     ((ee_size_t)0x000F)
+#define DATA_VALID         ((ee_size_t)0x0000)
+/* 批量写入结尾记录的状态，结尾记录覆盖整个批量写入在数据区占用的空间 */
+#define DATA_BATCH_OPEN    ((ee_size_t)0xFF00)
+#define DATA_BATCH_COMMIT  ((ee_size_t)0xF000)
+/* 检查点由若干条保存索引位置的记录和最后一个头记录组成，头记录保存检查点时的数据区写入游标
+ * 写入上面几种状态时断电，写了一部分的状态不会变成检查点的状态(例如结尾记录写到一半的0xFF0F) */
+#define DATA_CHECKPOINT      ((ee_size_t)0x0F0F)
+#define DATA_CHECKPOINT_BODY ((ee_size_t)0xF0F0)
+/* 写入状态时断电，状态可能只写了一部分：invalid已经写完说明索引的大小和地址已经写完，之后的状态写了一部分时数据可能已经写入；
+ * 结尾记录的低字节写完(提交写了一部分)说明结尾记录覆盖的数据可能已经写入 */
+#define DATA_STATUS_WRITTEN(status)  ((((status) & (ee_size_t)~0xFF) == 0) && ((status) != DATA_INVALID))
+#define DATA_STATUS_TRAILER(status)  ((((status) & (ee_size_t)0xFF) == 0) && ((status) != DATA_VALID))
 
 /* 每个块状态，用于块交换时使用 */
 #define REGION_ERASING      ((ee_uint32)0xFFFFFFFF)
 #define REGION_VERIFIED     ((ee_uint32)0x00FFFFFF)
 #define REGION_COPY         ((ee_uint32)0x0000FFFF)
 #define REGION_ACTIVE       ((ee_uint32)0x000000FF)
+/* 交换完成后旧的活动区，等待擦除 */
+#define REGION_OBSOLETE     ((ee_uint32)0x00000000)
+
+#if EE_USE_INDEX_TABLE
+/* RAM索引表中表示当前数据没有有效索引 */
+#define INDEX_TABLE_NONE    ((ee_uint32)0xFFFFFFFF)
+#endif
+
+/* 非数据环模式下，区域交换由ee_gcStep()分步完成 */
+#define INCREMENTAL_SWAP    (EE_USE_INCREMENTAL_GC && !EE_USE_DATA_RING)
+
+#if INCREMENTAL_SWAP
+/* 增量垃圾回收的阶段 */
+#define GC_ERASE            0   /* 逐个扇区检查并擦除交换区 */
+#define GC_IDLE             1   /* 交换区已经擦除，等待开始拷贝 */
+#define GC_COPY             2   /* 逐个将数据拷贝到交换区 */
+#define GC_MERGE            3   /* 重新拷贝在拷贝之后又被重写的数据，完成后切换活动区 */
+#endif
+
+#if EE_USE_DATA_RING
+#if !EE_USE_INDEX_TABLE
+#error "EE_USE_DATA_RING需要开启EE_USE_INDEX_TABLE，回收扇区时通过RAM索引表找到扇区中的有效数据"
+#endif
+/* 数据环中每个扇区头部保存扇区序号和序号取反，共8字节 */
+#define RING_SECTOR_HEADER_SIZE 8
+/* 普通写入给回收扇区保留的空闲扇区个数
+ * 回收时断电会在头扇区留下一条只搬了一半的数据，重新回收时可能需要多用一个扇区 */
+#define RING_RESERVED_SECTORS   2
+#endif
+
+#if EE_USE_HOT_COLD && !EE_USE_DATA_RING
+#error "EE_USE_HOT_COLD需要开启EE_USE_DATA_RING，冷热数据按扇区分开存放和回收"
+#endif
+
+#if EE_USE_LOCK && EE_USE_READ_CACHE
+#error "EE_USE_LOCK不能和EE_USE_READ_CACHE同时开启，读缓存在读取时也会被修改，多个读操作不能同时进行"
+#endif
+
+#if EE_USE_ASYNC_ERASE && !EE_USE_INCREMENTAL_GC
+#error "EE_USE_ASYNC_ERASE需要开启EE_USE_INCREMENTAL_GC，擦除只在ee_gcStep()中异步进行"
+#endif
 
-/* 数据索引结构 */
+#if EE_USE_ASYNC_WRITE && (!EE_USE_ASYNC_ERASE || EE_USE_DATA_RING)
+#error "EE_USE_ASYNC_WRITE需要开启EE_USE_ASYNC_ERASE并且不能开启EE_USE_DATA_RING，ee_poll()通过增量回收的交换区擦除腾出空间"
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+#if EE_USE_ASYNC_ERASE || defined(ee_flashEraseABlock) || defined(ee_flashBlankCheck)
+#error "EE_USE_MULTI_INSTANCE不能和EE_USE_ASYNC_ERASE、ee_flashEraseABlock、ee_flashBlankCheck同时使用，这些驱动函数没有区分实例"
+#endif
+/* 当前实例的数据个数 */
+#define INSTANCE_DATA_NUM(pobj) ((ee_uint32)(pobj)->dataNum)
+#else
+#define INSTANCE_DATA_NUM(pobj) DATA_NUM
+#endif
+
+#if EE_USE_STRIPE
+#if EE_USE_MULTI_INSTANCE || EE_USE_ASYNC_ERASE || defined(ee_flashEraseABlock) || defined(ee_flashBlankCheck)
+#error "EE_USE_STRIPE不能和EE_USE_MULTI_INSTANCE、EE_USE_ASYNC_ERASE、ee_flashEraseABlock、ee_flashBlankCheck同时使用，两片flash只通过条带驱动函数访问"
+#endif
+#if !defined(ee_stripeWriteStart) || !defined(ee_stripeRead) || !defined(ee_stripeEraseStart) || !defined(ee_stripeIsBusy)
+#error "EE_USE_STRIPE需要填写ee_stripeWriteStart、ee_stripeRead、ee_stripeEraseStart、ee_stripeIsBusy四个驱动函数名"
+#endif
+#if (SECTOR_SIZE % (2 * FLASH_PAGE_SIZE)) != 0
+#error "EE_USE_STRIPE需要SECTOR_SIZE是2倍FLASH_PAGE_SIZE的整数倍，每个扇区在两片flash上各占一个扇区"
+#endif
+/* 地址所在的flash，相邻两页在不同的flash上 */
+#define STRIPE_DEV(addr)    ((ee_uint8)(((addr) / FLASH_PAGE_SIZE) & 1))
+/* 地址在所在flash上的地址 */
+#define STRIPE_ADDR(addr)   (((addr) / (2 * FLASH_PAGE_SIZE)) * FLASH_PAGE_SIZE + (addr) % FLASH_PAGE_SIZE)
+#endif
+
+#if EE_USE_XIP && EE_USE_STRIPE
+#error "EE_USE_XIP不能和EE_USE_STRIPE同时开启，条带分布的数据在地址空间中不连续"
+#endif
+
+#if EE_USE_CHECKPOINT
+#if !EE_USE_INDEX_TABLE
+#error "EE_USE_CHECKPOINT需要开启EE_USE_INDEX_TABLE，检查点保存的是RAM索引表中每个数据的最新索引位置"
+#endif
+/* 检查点中保存索引位置的记录个数，每条记录保存3个数据 */
+#define CHECKPOINT_BODY_NUM(pobj) ((INSTANCE_DATA_NUM(pobj) + 2) / 3)
+#endif
+
+#if EE_USE_COMPRESS
+#if !EE_USE_WIDE_INDEX && (EE_COMPRESS_BUF_SIZE >= 0x8000)
+#error "EE_COMPRESS_BUF_SIZE必须小于32KB，压缩后的数据大小不能占用压缩标志位"
+#endif
+/* 索引中数据大小的最高位为1时数据是压缩保存的，数据开头保存原始大小，后面是压缩后的数据 */
+#define DATA_COMPRESSED     ((ee_size_t)1 << (sizeof(ee_size_t) * 8 - 1))
+/* 数据在数据区中占用的字节数 */
+#define RECORD_SIZE(size)   ((ee_size_t)((size) & ~DATA_COMPRESSED))
+#else
+#define RECORD_SIZE(size)   (size)
+#endif
+
+/* 数据索引结构(开启EE_USE_WIDE_INDEX时每个成员为32位) */
 typedef struct 
 {
 	/* 当前数据状态 */
-	ee_uint16 dataStatus;
+	ee_size_t dataStatus;
 	/* 当前数据大小 */
-	ee_uint16 dataSize;
+	ee_size_t dataSize;
 	/* 当前数据在数据区的地址(相对于dataStartAddr的偏移地址) */
-	ee_uint16 dataAddr;
-	/* 当前数据被重写的地址(相对于overwriteAddr的偏移地址)，默认为0xFFFF */
-	ee_uint16 dataOverwriteAddr;
+	ee_size_t dataAddr;
+	/* 当前数据被重写的地址(相对于overwriteAddr的偏移地址)，默认为全1 */
+	ee_size_t dataOverwriteAddr;
 }ee_dataIndex;
 
+#if EE_USE_BATCH_WRITE
+/* 批量写入的编号表：第0项为数据个数，之后依次为每个数据的id，写入重写区的id最高位为1 */
+#define BATCH_ID_OVERWRITE  ((ee_uint16)0x8000)
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+/* 多实例时工作缓冲区属于各自的ee_flash_t，不同实例可以同时写入 */
+#define INSTANCE_COPY_BUF(pobj)      ((pobj)->copyBuffer)
+#define INSTANCE_COMPRESS_BUF(pobj)  ((pobj)->compressBuffer)
+#define INSTANCE_BATCH_IDS(pobj)     ((pobj)->batchIdList)
+#else
+/* 区域交换时搬运数据使用的缓冲区 */
+/* 按4字节对齐，挂载时也用来成块读取索引区 */
+static ee_uint32 copyBuffer[(EE_COPY_BUF_SIZE + 3) / 4];
+#define INSTANCE_COPY_BUF(pobj)      copyBuffer
+
+#if EE_USE_COMPRESS
+/* 写入前压缩数据使用的缓冲区，开头保存原始大小 */
+static ee_uint32 compressBuffer[(EE_COMPRESS_BUF_SIZE + 3) / 4];
+#define INSTANCE_COMPRESS_BUF(pobj)  compressBuffer
+#endif
+
+#if EE_USE_BATCH_WRITE
+static ee_uint16 batchIdList[EE_BATCH_MAX_NUM + 1];
+#define INSTANCE_BATCH_IDS(pobj)     batchIdList
+#endif
+#endif
+
+static ee_uint8 writeData(ee_flash_t* pobj, void* buf, ee_size_t bufSize, variableLists dataId);
+#if EE_USE_BATCH_WRITE
+static ee_uint8 writeBatch(ee_flash_t* pobj, ee_batchItem_t* items, ee_uint16 itemNum);
+#endif
+#if EE_USE_INCREMENTAL_GC
+static ee_uint8 gcStep(ee_flash_t* pobj, ee_uint16 budget);
+#endif
+#if EE_USE_ASYNC_WRITE
+static ee_uint8 pollWrite(ee_flash_t* pobj, ee_writeHandle_t* phandle);
+static ee_uint8 writeNeedsSwap(ee_flash_t* pobj, ee_size_t bufSize, variableLists dataId);
+#endif
+#if EE_USE_LOCK
+static void seqWriteBegin(ee_flash_t* pobj);
+static void seqWriteEnd(ee_flash_t* pobj);
+static ee_uint32 seqReadBegin(ee_flash_t* pobj);
+static ee_uint8 seqReadRetry(ee_flash_t* pobj, ee_uint32 seq);
+#endif
+static void flashWrite(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num);
+static void flashWriteCombine(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num);
+#if EE_USE_WRITE_COMBINE
+static void flashWriteFlush(ee_flash_t* pobj);
+#endif
+static void flashRead(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num);
+static void flashEraseSector(ee_flash_t* pobj, ee_uint32 flashAddr);
+#ifdef ee_flashEraseABlock
+static void flashEraseBlock(ee_flash_t* pobj, ee_uint32 flashAddr);
+#endif
+#if EE_USE_ASYNC_ERASE
+static void flashEraseSectorAsync(ee_flash_t* pobj, ee_uint32 flashAddr);
+static void flashWaitReady(ee_flash_t* pobj);
+#endif
+#if EE_USE_STRIPE
+static void stripeWrite(ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num);
+static void stripeRead(ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num);
+static void stripeEraseSector(ee_uint32 flashAddr);
+#endif
+#if EE_USE_STATS
+static void statsGcBegin(ee_flash_t* pobj);
+static void statsGcEnd(ee_flash_t* pobj);
+static void statsErase(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint16 sectorNum);
+#endif
 static void swapRegion(ee_flash_t* pobj);
-static void countAreaPlusOne(ee_flash_t* pobj);
+#if !INCREMENTAL_SWAP
+static void swapData(ee_flash_t* pobj);
+static ee_uint8 transferLatestRecord(ee_flash_t* pobj, variableLists dataId, ee_uint32* newDataAddr, ee_dataIndex* pindex);
+#endif
+static void transferDataAndIndex(ee_flash_t* pobj, ee_dataIndex* pindex, ee_uint32* newDataAddr, ee_uint32 newIndexAddr);
+static void activateSwapRegion(ee_flash_t* pobj, ee_uint32 dataFreeAddr, ee_uint32 overwriteUsedSize);
+static void countAreaAdd(ee_flash_t* pobj, ee_uint32 num);
+#if !EE_USE_DATA_RING
 static ee_uint32 getFreeAddrInDataRegion(ee_flash_t* pobj);
+#endif
 static ee_uint32 getFreeAddrInOverwriteArea(ee_flash_t* pobj);
+static ee_uint32 getIndexDataEnd(ee_dataIndex* pindex);
+static ee_uint8 countZeroBits(ee_uint32 value);
 static void eraseRegion(ee_flash_t *pobj, ee_uint32 regionAddr);
 static ee_uint8 verifyRegionFullyErased(ee_flash_t *pobj, ee_uint32 regionAddr);
+static ee_uint32 readRegionStatus(ee_flash_t *pobj, ee_uint32 regionAddr);
 static ee_uint32 getLastIndexAddrThatNotBeenOverwritten(ee_flash_t* pobj, variableLists dataId);
-static void writeIndexAndData(ee_flash_t* pobj, ee_uint32 writeDataAddr, ee_uint32 writeIndexAddr, void* buf, ee_uint16 bufSize);
+static ee_uint32 getNextIndexAddr(ee_flash_t* pobj, ee_size_t overwriteAddr);
+static void repairOverwriteLink(ee_flash_t* pobj);
+static ee_uint8 getLatestIndex(ee_flash_t* pobj, variableLists dataId, ee_dataIndex* pindex);
+static void writeIndexAndData(ee_flash_t* pobj, ee_uint32 writeDataAddr, ee_uint32 writeIndexAddr, void* buf, ee_uint32 srcFlashAddr, ee_size_t bufSize);
+static void writeRecord(ee_flash_t* pobj, variableLists dataId, ee_dataIndex* pcurrentIndex, void* buf, ee_uint32 srcFlashAddr, ee_size_t bufSize);
+static void writeRecordData(ee_flash_t* pobj, ee_uint32 writeDataAddr, void* buf, ee_uint32 srcFlashAddr, ee_size_t bufSize);
+static void copyFlashData(ee_flash_t* pobj, ee_uint32 srcAddr, ee_uint32 dstAddr, ee_uint32 size);
+static ee_size_t getRecordSize(ee_flash_t* pobj, ee_dataIndex* pindex);
+static void readRecord(ee_flash_t* pobj, ee_dataIndex* pindex, ee_uint8* buf, ee_size_t offset, ee_size_t len);
+#if EE_USE_COMPRESS
+static ee_uint32 compressData(ee_uint8* src, ee_size_t srcSize, ee_uint8* dst, ee_uint32 dstSize);
+static void decompressData(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint32 streamSize, ee_uint8* buf, ee_size_t offset, ee_size_t len);
+#endif
+static ee_uint8 verifyRangeErased(ee_flash_t *pobj, ee_uint32 startAddr, ee_uint32 endAddr);
+static ee_uint8 isOverwriteAreaFull(ee_flash_t* pobj);
+#if EE_USE_SKIP_UNCHANGED
+static ee_uint8 isRecordUnchanged(ee_flash_t* pobj, variableLists dataId, ee_uint8* buf, ee_size_t bufSize);
+#endif
 static void flashMemMangHandle_Init(ee_flash_t* pobj,ee_uint32 indexStartAddr,ee_uint32 indexSwapStartAddr,ee_uint16 indexRegionSize,ee_uint16 indexSize,ee_uint32 dataStartAddr,ee_uint32 dataSwapStartAddr,ee_uint16 dataRegionSize);
+#if EE_USE_INDEX_TABLE
+static void buildIndexTable(ee_flash_t* pobj);
+static void resolveIndexTable(ee_flash_t* pobj, variableLists dataId, ee_uint32 indexAddr);
+static void setIndexTable(ee_flash_t* pobj, variableLists dataId, ee_uint32 indexAddr, ee_size_t dataSize, ee_size_t dataAddr);
+#endif
+#if EE_USE_CHECKPOINT
+static void writeCheckpoint(ee_flash_t* pobj);
+static ee_uint8 loadCheckpoint(ee_flash_t* pobj);
+#endif
+#if EE_USE_DATA_RING
+static void ringRecover(ee_flash_t* pobj);
+static ee_uint32 ringRecoverFreeAddr(ee_flash_t* pobj, ee_uint16 sector);
+static void ringOpenSector(ee_flash_t* pobj, ee_uint16 sector);
+static ee_uint16 ringFreeSectors(ee_flash_t* pobj);
+static ee_uint8 ringAlloc(ee_flash_t* pobj, ee_size_t size, ee_uint8 isGc);
+static ee_uint16 ringNextFreeSector(ee_flash_t* pobj);
+static ee_uint8 ringReclaimSector(ee_flash_t* pobj);
+static ee_uint8 ringMoveSector(ee_flash_t* pobj, ee_uint32 sectorStartAddr);
+#if EE_USE_INCREMENTAL_GC || EE_USE_HOT_COLD
+static ee_uint32 ringLiveSize(ee_flash_t* pobj, ee_uint16 sector);
+#endif
+#if EE_USE_HOT_COLD
+static ee_uint16 ringPickVictim(ee_flash_t* pobj, ee_uint32* pliveSize);
+static void ringSwapFrontier(ee_flash_t* pobj);
+#endif
+#if EE_USE_INCREMENTAL_GC
+static ee_uint8 ringNeedGc(ee_flash_t* pobj);
+#endif
+#endif
+#if EE_USE_BATCH_WRITE
+static ee_uint8 planBatch(ee_flash_t* pobj, ee_batchItem_t* items, ee_uint16 itemNum, ee_uint32* poverwriteNum);
+static ee_uint8 isBatchOverwriteFull(ee_flash_t* pobj, ee_uint32 overwriteNum);
+static void commitBatchIndex(ee_flash_t* pobj, variableLists dataId, ee_uint32 newIndexAddr, ee_uint32 lastIndexAddr);
+static void recoverBatch(ee_flash_t* pobj);
+#endif
+#if EE_USE_READ_CACHE
+static ee_cacheEntry_t* cacheFind(ee_flash_t* pobj, variableLists dataId);
+static ee_cacheEntry_t* cacheGet(ee_flash_t* pobj, variableLists dataId);
+static ee_cacheEntry_t* cacheAlloc(ee_flash_t* pobj, variableLists dataId);
+static void cacheUpdate(ee_flash_t* pobj, variableLists dataId, ee_uint8* buf, ee_size_t bufSize);
+#endif
+#if INCREMENTAL_SWAP
+static ee_uint8 gcAdvance(ee_flash_t* pobj, ee_uint16 budget, ee_uint8 force);
+static ee_uint8 gcNeeded(ee_flash_t* pobj);
+static void gcEraseStep(ee_flash_t* pobj);
+static void gcStartCopy(ee_flash_t* pobj);
+static ee_uint8 gcMergeStep(ee_flash_t* pobj);
+static void gcCopyRecord(ee_flash_t* pobj, variableLists dataId);
+static void gcMarkDirty(ee_flash_t* pobj, variableLists dataId);
+#endif
 
 /**
  * @brief 格式化传入函数地址flash
@@ -54,7 +310,7 @@ static void flashMemMangHandle_Init(ee_flash_t* pobj,ee_uint32 indexStartAddr,ee
  * @param indexRegionSize      总索引区大小(单位：扇区)
  * @param indexSize            索引区大小(详见README图例，要小于indexRegionSize)
  * @param dataStartAddr        数据区起始地址
- * @param dataSwapStartAddr    交换数据区起始地址
+ * @param dataSwapStartAddr    交换数据区起始地址(开启EE_USE_DATA_RING时不使用)
  * @param dataRegionSize       数据区大小(单位：扇区)
  */
 void ee_flashInit(ee_flash_t *pobj,              \
@@ -69,9 +325,60 @@ void ee_flashInit(ee_flash_t *pobj,              \
 	ee_uint32 regionStatus = 0;
 	ee_uint32 swapRegionStatus = 0;
 
+#if EE_USE_OP_COUNTER
+	/* 从初始化开始统计，可以得到挂载本身的开销 */
+	ee_clearOpCounter(pobj);
+#endif
+
+#if EE_USE_STATS
+	/* 统计结果不清零，可以在初始化前用ee_setStats()恢复 */
+	pobj->statsGcDepth = 0;
+#endif
+
+#if EE_USE_READ_CACHE
+	/* 清空读缓存 */
+	{
+		ee_uint16 i;
+
+		for (i = 0; i < EE_READ_CACHE_NUM; i++)
+		{
+			pobj->cache[i].used = 0;
+			pobj->cache[i].pinned = 0;
+		}
+
+		pobj->cacheTick = 0;
+		pobj->cacheHits = 0;
+		pobj->cacheMisses = 0;
+	}
+#endif
+
+#if EE_USE_DATA_RING
+	/* 数据环没有交换区，索引区交换时数据区保持不变 */
+	dataSwapStartAddr = dataStartAddr;
+#endif
+
+#if EE_USE_WRITE_COMBINE
+	/* 所有状态都从flash中重新建立，丢弃复位前没有写入的合并数据 */
+	pobj->combineLen = 0;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+	/* 不知道之前是否有还没有完成的擦除，第一次访问flash前先等待 */
+	pobj->eraseBusy = 1;
+#endif
+
+#if EE_USE_LOCK
+	pobj->seq = 0;
+	pobj->seqDepth = 0;
+#endif
+
+#if EE_USE_XIP
+	pobj->xipGeneration = 0;
+#endif
+
 	/* 读取活动区和交换区的状态 */
-	ee_flashRead(indexStartAddr, (ee_uint8*)&regionStatus, 4);
-	ee_flashRead(indexSwapStartAddr, (ee_uint8*)&swapRegionStatus, 4);
+	regionStatus = readRegionStatus(pobj, indexStartAddr);
+	swapRegionStatus = readRegionStatus(pobj, indexSwapStartAddr);
 
 	switch (regionStatus)
 	{
@@ -80,7 +387,8 @@ void ee_flashInit(ee_flash_t *pobj,              \
 			switch (swapRegionStatus)
 			{
 				case REGION_ERASING:
-					/* 正常情况 */
+				case REGION_OBSOLETE:
+					/* 正常情况(交换区为obsolete说明上次交换后旧的活动区还没有擦除) */
                     flashMemMangHandle_Init(pobj, indexStartAddr, indexSwapStartAddr, indexRegionSize, indexSize, dataStartAddr, dataSwapStartAddr, dataRegionSize);
                     break;
 
@@ -89,8 +397,13 @@ void ee_flashInit(ee_flash_t *pobj,              \
 					/* 当活动区avtive，交换区处于copy或者varified状态说明都要进行区域交换 */
 					flashMemMangHandle_Init(pobj, indexStartAddr, indexSwapStartAddr, indexRegionSize, indexSize, dataStartAddr, dataSwapStartAddr, dataRegionSize);
 
-					/* 交换索引区域 */
+#if INCREMENTAL_SWAP
+					/* 增量回收时活动区中的数据仍然完整，交换区留给ee_gcStep()重新擦除 */
+#else
+					/* 交换索引区域(遍历重写链需要重写区写入游标) */
+					pobj->overwriteFreeAddr = getFreeAddrInOverwriteArea(pobj);
 					swapRegion(pobj);
+#endif
 					break;
 					
 				default:
@@ -111,9 +424,11 @@ void ee_flashInit(ee_flash_t *pobj,              \
 					eraseRegion(pobj, pobj->indexStartAddr);
 					eraseRegion(pobj, pobj->dataStartAddr);
 
-					/* 擦除交换区 */
+					/* 擦除交换区(数据环模式没有数据交换区) */
 					eraseRegion(pobj, pobj->indexSwapStartAddr);
+#if !EE_USE_DATA_RING
 					eraseRegion(pobj, pobj->dataSwapStartAddr);
+#endif
 
 					/* 验证是否完全擦除 */
                     if (!verifyRegionFullyErased(pobj, pobj->indexStartAddr) && \
@@ -121,29 +436,58 @@ void ee_flashInit(ee_flash_t *pobj,              \
                     {
 						regionStatus = REGION_ACTIVE;
 
-						ee_flashWrite(indexStartAddr, (ee_uint8*)&regionStatus, 4);
+						flashWrite(pobj, indexStartAddr, (ee_uint8*)&regionStatus, 4);
 					}
 					break;
 
 				case REGION_ACTIVE:
-					/* 活动在交换区 */
-					flashMemMangHandle_Init(pobj, indexSwapStartAddr, indexStartAddr, indexRegionSize, indexSize, dataStartAddr, dataSwapStartAddr, dataRegionSize);
+					/* 活动在交换区，数据区和索引区总是一起交换的 */
+					flashMemMangHandle_Init(pobj, indexSwapStartAddr, indexStartAddr, indexRegionSize, indexSize, dataSwapStartAddr, dataStartAddr, dataRegionSize);
 					break;
 
 				default:
 					/* 异常情况直接复位flash */
 					goto resetFlash;
 			}
+			break;
 
 		case REGION_COPY:
 		case REGION_VERIFIED:
-			/* 说明之前活动在交换区，在进行区域交换时被终止*/
-            if (swapRegionStatus == REGION_ACTIVE)
+            if ((regionStatus == REGION_COPY) && (swapRegionStatus == REGION_OBSOLETE))
             {
-				flashMemMangHandle_Init(pobj, indexSwapStartAddr, indexStartAddr, indexRegionSize, indexSize, dataStartAddr, dataSwapStartAddr, dataRegionSize);
+                /* 拷贝已经完成，旧的活动区已经作废，只差将拷贝的区域设置为active */
+                flashMemMangHandle_Init(pobj, indexStartAddr, indexSwapStartAddr, indexRegionSize, indexSize, dataStartAddr, dataSwapStartAddr, dataRegionSize);
 
-				swapRegion(pobj);
-			}
+                regionStatus = REGION_ACTIVE;
+                flashWrite(pobj, indexStartAddr, (ee_uint8 *)&regionStatus, 4);
+                break;
+            }
+
+			/* 说明之前活动在交换区，在进行区域交换时被终止*/
+            if (swapRegionStatus != REGION_ACTIVE)
+                goto resetFlash;
+
+			flashMemMangHandle_Init(pobj, indexSwapStartAddr, indexStartAddr, indexRegionSize, indexSize, dataSwapStartAddr, dataStartAddr, dataRegionSize);
+
+#if !INCREMENTAL_SWAP
+			pobj->overwriteFreeAddr = getFreeAddrInOverwriteArea(pobj);
+			swapRegion(pobj);
+#endif
+			break;
+
+		case REGION_OBSOLETE:
+			/* 活动区已经换到交换区 */
+            if ((swapRegionStatus != REGION_ACTIVE) && (swapRegionStatus != REGION_COPY))
+                goto resetFlash;
+
+			flashMemMangHandle_Init(pobj, indexSwapStartAddr, indexStartAddr, indexRegionSize, indexSize, dataSwapStartAddr, dataStartAddr, dataRegionSize);
+
+            if (swapRegionStatus == REGION_COPY)
+            {
+                /* 拷贝已经完成，只差将交换区设置为active */
+                regionStatus = REGION_ACTIVE;
+                flashWrite(pobj, indexSwapStartAddr, (ee_uint8 *)&regionStatus, 4);
+            }
 			break;
 
 resetFlash:
@@ -155,9 +499,11 @@ resetFlash:
 			eraseRegion(pobj, pobj->indexStartAddr);
 			eraseRegion(pobj, pobj->dataStartAddr);
 
-			/* 擦除交换区 */
+			/* 擦除交换区(数据环模式没有数据交换区) */
 			eraseRegion(pobj, pobj->indexSwapStartAddr);
+#if !EE_USE_DATA_RING
 			eraseRegion(pobj, pobj->dataSwapStartAddr);
+#endif
 
 			/* 验证是否完全擦除 */
             if (!verifyRegionFullyErased(pobj, pobj->indexStartAddr) && \
@@ -165,10 +511,43 @@ resetFlash:
             {
                 regionStatus = REGION_ACTIVE;
 
-                ee_flashWrite(indexStartAddr, (ee_uint8 *)&regionStatus, 4);
+                flashWrite(pobj, indexStartAddr, (ee_uint8 *)&regionStatus, 4);
             }
             break;
 	}
+
+	/* 活动区确定后，恢复重写区和数据区的写入位置，之后的写入只需要移动游标 */
+	pobj->overwriteFreeAddr = getFreeAddrInOverwriteArea(pobj);
+
+	/* 上次写入重写地址时断电，先把它修复，之后遍历重写链时不会走到错误的位置 */
+	repairOverwriteLink(pobj);
+
+#if EE_USE_BATCH_WRITE
+	/* 上次批量写入已经提交但还没有全部生效时，先让它全部生效 */
+	recoverBatch(pobj);
+#endif
+
+#if EE_USE_INDEX_TABLE
+	/* 活动区确定后，建立RAM索引表 */
+#if EE_USE_CHECKPOINT
+	/* 有检查点时只需要从检查点记录的位置继续遍历重写链 */
+	if (!loadCheckpoint(pobj))
+#endif
+	buildIndexTable(pobj);
+#endif
+
+#if EE_USE_DATA_RING
+	/* 数据环的头尾由扇区序号和RAM索引表恢复 */
+	ringRecover(pobj);
+#else
+	pobj->dataFreeAddr = getFreeAddrInDataRegion(pobj);
+#endif
+
+#if INCREMENTAL_SWAP
+	/* 挂载时不知道交换区是否已经完全擦除，由ee_gcStep()从头检查 */
+	pobj->gcState = GC_ERASE;
+	pobj->gcSector = 0;
+#endif
 }
 
 /**
@@ -215,568 +594,3738 @@ static void flashMemMangHandle_Init(ee_flash_t *pobj,               \
  *
  * @retval        0: 写入成功
  *                1: 写入的数据超过索引区
- *                2: 当前写入的数据id，没有遵循variableLists中的顺序写入
+ *                3: 数据区剩余空间不足
+ *                4: 开启EE_USE_COMPRESS时数据大小占用了压缩标志位(超过ee_size_t最大值的一半)
+ */
+ee_uint8 ee_writeDataToFlash(ee_flash_t* pobj, void* buf, ee_size_t bufSize, variableLists dataId)
+{
+#if EE_USE_LOCK
+    ee_uint8 ret;
+
+    ee_writeLock();
+    ret = writeData(pobj, buf, bufSize, dataId);
+    ee_writeUnlock();
+
+    return ret;
+#else
+    return writeData(pobj, buf, bufSize, dataId);
+#endif
+}
+
+/**
+ * @brief: ee_writeDataToFlash()的实现
  */
-ee_uint8 ee_writeDataToFlash(ee_flash_t* pobj, void* buf, ee_uint16 bufSize, variableLists dataId)
+static ee_uint8 writeData(ee_flash_t* pobj, void* buf, ee_size_t bufSize, variableLists dataId)
 {
     ee_dataIndex currentdataIndex;
-    ee_uint32 dataRegionFreeAddr = 0;
     ee_uint32 writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+#if EE_USE_STATS
+    ee_size_t logicalSize = bufSize;
+#endif
+#if EE_USE_COMPRESS
+    ee_uint32 i, compressSize;
+#if EE_USE_READ_CACHE
+    void* rawBuf = buf;
+    ee_size_t rawSize = bufSize;
+#endif
+#endif
 
-    /* 写入的数据超过索引区，直接返回 */
-    if (writeIndexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
+    /* 写入的数据超过索引区或者不在本实例的数据个数内，直接返回 */
+    if ((writeIndexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize)) || ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj)))
         return 1;
 
-    if (dataId != 0)
+#if EE_USE_COMPRESS
+    /* 数据大小的最高位是压缩标志，不压缩保存时也不能超过 */
+    if (bufSize & DATA_COMPRESSED)
+        return 4;
+
+    /* 压缩后加上原始大小仍然更小时才保存压缩的数据，之后按普通数据写入(大小带有压缩标志) */
+    compressSize = compressData((ee_uint8 *)buf, bufSize, (ee_uint8 *)INSTANCE_COMPRESS_BUF(pobj) + sizeof(ee_size_t), sizeof(INSTANCE_COMPRESS_BUF(pobj)) - sizeof(ee_size_t));
+    if ((compressSize != 0) && ((compressSize + sizeof(ee_size_t)) < bufSize))
+    {
+        /* 原始大小按字节写在压缩数据前面，字节顺序与读取时读入ee_size_t变量的相同 */
+        for (i = 0; i < sizeof(ee_size_t); i++)
+            ((ee_uint8 *)INSTANCE_COMPRESS_BUF(pobj))[i] = ((ee_uint8 *)&bufSize)[i];
+        buf = INSTANCE_COMPRESS_BUF(pobj);
+        bufSize = (ee_size_t)(compressSize + sizeof(ee_size_t)) | DATA_COMPRESSED;
+    }
+#endif
+
+#if EE_USE_SKIP_UNCHANGED
+    /* 与flash中当前的数据完全相同，不需要写入 */
+    if (isRecordUnchanged(pobj, dataId, (ee_uint8 *)buf, bufSize))
+        return 0;
+#endif
+
+    /* 获取当前数据索引的信息 */
+    flashRead(pobj, writeIndexAddr, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
+
+#if EE_USE_DATA_RING
+    /* 在数据环中为新数据分配空间，空间不足时回收最旧的扇区 */
+    if (ringAlloc(pobj, RECORD_SIZE(bufSize), 0))
+        return 3;
+
+    /* 回收扇区时可能交换过索引区，重新获取当前数据索引的信息 */
+    writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+    flashRead(pobj, writeIndexAddr, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
+
+    /* 重写区溢出时只交换索引区，数据留在数据环中不动 */
+    if ((currentdataIndex.dataStatus != DATA_EMPTY) && isOverwriteAreaFull(pobj))
+    {
+        swapRegion(pobj);
+
+        /* 活动区已经改变，重新获取当前数据索引的信息 */
+        writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+        flashRead(pobj, writeIndexAddr, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
+    }
+#else
+    /* 若数据区溢出，或者需要写入重写区时重写区溢出 */
+    if (((pobj->dataFreeAddr + RECORD_SIZE(bufSize)) > SECTORS(pobj->dataRegionSize)) || \
+        ((currentdataIndex.dataStatus != DATA_EMPTY) && isOverwriteAreaFull(pobj)))
     {
-        ee_dataIndex preDataIndex;
+        /* 交换活动空间 */
+        swapRegion(pobj);
 
-        /* 获取上一个数据索引有没有写入 */
-        ee_flashRead(pobj->indexStartAddr + sizeof(ee_dataIndex) * (dataId - 1), (ee_uint8 *)&preDataIndex, sizeof(preDataIndex));
+        /* 交换后数据只剩有效部分，仍然放不下则无法写入 */
+        if ((pobj->dataFreeAddr + RECORD_SIZE(bufSize)) > SECTORS(pobj->dataRegionSize))
+            return 3;
 
-        /* 上一个数据索引没有dataAddr写入直接返回 */
-        if ((preDataIndex.dataStatus == DATA_EMPTY) || (preDataIndex.dataStatus == DATA_INVALID))
-        {
-            /* 顺序存储的主要目的，就是为了快速定位数据区的空闲地址 */
-            return 2;
-        }
+        /* 活动区已经改变，重新获取当前数据索引的信息 */
+        writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+        flashRead(pobj, writeIndexAddr, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
     }
+#endif
 
-    /* 获得数据区空闲区地址 */
-    dataRegionFreeAddr = getFreeAddrInDataRegion(pobj);
+    writeRecord(pobj, dataId, &currentdataIndex, buf, 0, bufSize);
 
-    /* 获取当前数据索引的信息 */
-    ee_flashRead(writeIndexAddr, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
+#if EE_USE_STATS
+    /* 只统计真正写入的数据，失败和内容没有变化跳过的写入不计入 */
+    pobj->stats.logicalBytes += logicalSize;
+#endif
+
+#if EE_USE_COMPRESS && EE_USE_READ_CACHE
+    /* 读缓存中保存的是原始数据 */
+    if (buf != rawBuf)
+        cacheUpdate(pobj, dataId, (ee_uint8 *)rawBuf, rawSize);
+#endif
+
+#if EE_USE_CHECKPOINT
+    writeCheckpoint(pobj);
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief 在数据区写入游标处写入一条数据，并更新它的索引(调用前需要保证数据区和重写区空间足够)
+ *
+ * @param dataId        要写入的数据id
+ * @param pcurrentIndex 当前数据在索引区中的索引
+ * @param buf           写入数据的地址，为NULL时从flash的srcFlashAddr处搬运数据
+ * @param srcFlashAddr  搬运数据的flash地址(buf为NULL时有效)
+ * @param bufSize       索引中的数据大小(压缩保存时带有压缩标志)
+ */
+static void writeRecord(ee_flash_t* pobj, variableLists dataId, ee_dataIndex* pcurrentIndex, void* buf, ee_uint32 srcFlashAddr, ee_size_t bufSize)
+{
+    ee_uint32 dataRegionFreeAddr = pobj->dataFreeAddr;
+    ee_uint32 writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
 
     /* 当数据状态是valid或者invalid或者haldvalid都要向重写区重新写入新的数据索引 */
     /* 如果状态为invalid或halfvaild说明上次写入时，单片机断电或者复位了 */
-    if (currentdataIndex.dataStatus != DATA_EMPTY)
+    if (pcurrentIndex->dataStatus != DATA_EMPTY)
     {
         /* NOTE: 若数据状态是invalid或halfvalid时，因为无法保证下一次在在索引区相同地址写入时，
             * 索引数据的大小和上次写入失败时是一样的，因此舍弃索引区的数据索引，在重写区重新写入 */
         ee_uint32 lastIndexAddr, overwriteAreaFreeAddr, overwriteAreaBiasAddr; // 支持扩展寻址空间到4GB
 
         /* 首先找到最后一个没被重写的数据索引地址 */
+#if EE_USE_INDEX_TABLE
+        if (pobj->indexTable[dataId].indexAddr != INDEX_TABLE_NONE)
+            lastIndexAddr = pobj->indexTable[dataId].indexAddr;
+        else
+#endif
         lastIndexAddr = getLastIndexAddrThatNotBeenOverwritten(pobj, dataId);
 
-        /* 再找到重写区空闲位置的地址 */
-        overwriteAreaFreeAddr = getFreeAddrInOverwriteArea(pobj);
+        /* 重写区空闲位置的地址 */
+        overwriteAreaFreeAddr = pobj->overwriteFreeAddr;
 
         /* 写入索引的重写地址是偏移地址 */
         overwriteAreaBiasAddr = overwriteAreaFreeAddr - pobj->overwriteAddr;
 
-        /* 若重写区或数据区溢出 */
-        if ((overwriteAreaFreeAddr + sizeof(ee_dataIndex)) > (pobj->indexStartAddr - 4 + SECTORS(pobj->indexRegionSize)) || \
-            (dataRegionFreeAddr + bufSize) > SECTORS(pobj->dataRegionSize))
-        {
-            /* 交换活动空间 */
-            swapRegion(pobj);
-
-            /* 重新获得数据区空闲地址 */
-            dataRegionFreeAddr = getFreeAddrInDataRegion(pobj);
-
-            /* 刚交换完空间， 最后一个没被重写的数据索引地址即索引区的数据索引 */
-            lastIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
-
-            /* 重置重写区写入地址为起始地址，因为刚交换好区域，重写区空闲地址就是重写区起始地址 */
-            overwriteAreaFreeAddr = pobj->overwriteAddr;
-
-            /* 重写区第一个数据地址偏移为0 */
-            overwriteAreaBiasAddr = 0;
-        }
-
         /* 准备写入前，首先先把重写计数+1，以防写入时单片机断电或复位导致数据没有写入成功 */
-        countAreaPlusOne(pobj);
+        countAreaAdd(pobj, 1);
+        pobj->overwriteFreeAddr += sizeof(ee_dataIndex);
 
         /* 将索引写入重写区，数据写入数据区 */
-        writeIndexAndData(pobj, dataRegionFreeAddr, overwriteAreaFreeAddr, buf, bufSize);
+        /* 状态仍然按invalid、halfvalid、valid逐步写入：重写区最后一个索引的状态一次写入时，写入中途断电可能变成批量写入或检查点的状态 */
+        writeIndexAndData(pobj, dataRegionFreeAddr, overwriteAreaFreeAddr, buf, srcFlashAddr, bufSize);
 
         /* 最后将上一个索引的重写地址设置为当前刚刚写入的索引地址(一定是最后设置) */
         /* 如果程序在这里中断(没有进函数)，重写区将会出现一个valid的数据索引但是没有人指向它(没有索引知道它的存在)，因此也会被程序当成一个无效索引而跳过 */
-        ee_flashWrite(lastIndexAddr + sizeof(ee_dataIndex) - sizeof(currentdataIndex.dataOverwriteAddr), \
-                      (ee_uint8 *)&overwriteAreaBiasAddr,                                                \
-                      sizeof(currentdataIndex.dataOverwriteAddr));
+        flashWrite(pobj, lastIndexAddr + sizeof(ee_dataIndex) - sizeof(pcurrentIndex->dataOverwriteAddr), \
+                   (ee_uint8 *)&overwriteAreaBiasAddr,                                                    \
+                   sizeof(pcurrentIndex->dataOverwriteAddr));
+
+        writeIndexAddr = overwriteAreaFreeAddr;
     }
     else /* 状态为empty，说明是第一次写入 */
     {
             /* 将索引写入索引区 */
-            writeIndexAndData(pobj, dataRegionFreeAddr, writeIndexAddr, buf, bufSize);
+            writeIndexAndData(pobj, dataRegionFreeAddr, writeIndexAddr, buf, srcFlashAddr, bufSize);
     }
 
-    return 0;
+    /* 数据区写入游标后移 */
+    pobj->dataFreeAddr += RECORD_SIZE(bufSize);
+
+#if EE_USE_INDEX_TABLE
+    /* 写入完成后更新RAM索引表 */
+    setIndexTable(pobj, dataId, writeIndexAddr, bufSize, dataRegionFreeAddr);
+#endif
+
+#if EE_USE_READ_CACHE
+    /* 读缓存中有当前数据时同时更新(搬运数据时内容不变，压缩保存的数据由调用者用原始数据更新) */
+#if EE_USE_COMPRESS
+    if ((buf != 0) && !(bufSize & DATA_COMPRESSED))
+#else
+    if (buf != 0)
+#endif
+        cacheUpdate(pobj, dataId, (ee_uint8 *)buf, bufSize);
+#endif
+
+#if INCREMENTAL_SWAP
+    gcMarkDirty(pobj, dataId);
+#endif
 }
 
+#if EE_USE_SKIP_UNCHANGED
 /**
- * @brief        从flash读取数据
+ * @brief 比较要写入的数据和当前数据是否完全相同(先比较大小，再分块读出数据比较)
  *
- * @param pobj   flash管理对象指针
- * @param buf    读取数据的地址
- * @param dataId 要读取的数据id(详见头文件枚举类型variableLists)
- *
- * @retval       0: 读取成功
- *               1: 读取的数据超过索引区
- *               2: 当前读取的数据id没有写入过
- *               3: 当前读取的数据id不是有效的
+ * @retval 0: 不同或当前没有有效数据 1: 完全相同
  */
-ee_uint8 ee_readDataFromFlash(ee_flash_t* pobj, void* buf, variableLists dataId)
+static ee_uint8 isRecordUnchanged(ee_flash_t* pobj, variableLists dataId, ee_uint8* buf, ee_size_t bufSize)
 {
-    ee_dataIndex readIndex;
-    ee_uint32 readIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
-
-    /* 读取的数据超过索引区，直接返回 */
-    if (readIndexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
-            return 1;
+    ee_uint32 i, j, len;
+    ee_dataIndex latestIndex;
 
-    /* 获取当前数据索引的信息 */
-    ee_flashRead(readIndexAddr, (ee_uint8 *)&readIndex, sizeof(readIndex));
+    /* 当前没有有效数据，或者大小不同，数据一定有变化 */
+    if (getLatestIndex(pobj, dataId, &latestIndex) || (latestIndex.dataSize != bufSize))
+        return 0;
 
-    if (readIndex.dataStatus != DATA_EMPTY)
+    for (i = 0; i < RECORD_SIZE(bufSize); i += len)
     {
-        /* 当前数据被重写了。因为重写索引地址是在重写流程的最后才被赋值的，
-            * 所以程序保证只要数据被重写那么被重写的索引一定是可用的 */
-        if (readIndex.dataOverwriteAddr != (ee_uint16)0xFFFF)
-        {
-            /* 获取最后一个没被重写的索引 */
-            ee_uint32 lastIndexAddr = getLastIndexAddrThatNotBeenOverwritten(pobj, dataId);
+        len = RECORD_SIZE(bufSize) - i;
+        if (len > sizeof(INSTANCE_COPY_BUF(pobj)))
+            len = sizeof(INSTANCE_COPY_BUF(pobj));
 
-            /* 获取最后一个重写索引的信息 */
-            ee_flashRead(lastIndexAddr, (ee_uint8 *)&readIndex, sizeof(readIndex));
+        flashRead(pobj, pobj->dataStartAddr + latestIndex.dataAddr + i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), len);
 
-            /* 去数据区读数据 */
-            ee_flashRead(readIndex.dataAddr + pobj->dataStartAddr, (ee_uint8 *)buf, readIndex.dataSize);
-        }
-        else if (readIndex.dataStatus == DATA_VALID)
-        {
-            /* 当前数据重写没有被重写，同时数据有效，直接去数据区读数据 */
-            ee_flashRead(readIndex.dataAddr + pobj->dataStartAddr, (ee_uint8 *)buf, readIndex.dataSize);
-        }
-        else
+        for (j = 0; j < len; j++)
         {
-            /* 来到这里说明当前索引的数据不是有效的，同时还没有被重写过(或者重写失败了) */
-            return 3;
+            if (((ee_uint8 *)INSTANCE_COPY_BUF(pobj))[j] != buf[i + j])
+                return 0;
         }
     }
-    else /* 数据为空，直接返回 */
-    {
-        return 2;
-    }
 
-    return 0;
+    return 1;
 }
+#endif
 
 /**
- * @brief 将索引结构和数据写入flash
- *
- * @param writeDataAddr 将要写入的数据区目的地址
- * @param writeIndexAddr 将要希尔的索引区地址
- * @param buf 写入数据的指针
- * @param bufSize 写入数据的大小
+ * @brief: 重写区是否已经放不下一个新的索引
  */
-static void writeIndexAndData(ee_flash_t* pobj, ee_uint32 writeDataAddr, ee_uint32 writeIndexAddr, void* buf, ee_uint16 bufSize)
+static ee_uint8 isOverwriteAreaFull(ee_flash_t* pobj)
 {
-    ee_dataIndex dataIndex;
-    /* 写入前，先将当前数据索引设置为invalid状态 */
-    dataIndex.dataStatus = DATA_INVALID;
-
-    /* 写入当前状态 */
-    ee_flashWrite(writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
-
-    /* 现在将剩余结构成员写入 */
-    dataIndex.dataSize = bufSize;
-    dataIndex.dataAddr = writeDataAddr;
-    dataIndex.dataOverwriteAddr = 0xFFFF;
-    ee_flashWrite(writeIndexAddr + sizeof(dataIndex.dataStatus), (ee_uint8 *)&dataIndex.dataSize, sizeof(dataIndex) - sizeof(dataIndex.dataStatus));
+    return (pobj->overwriteFreeAddr + sizeof(ee_dataIndex)) > (pobj->indexStartAddr - 4 + SECTORS(pobj->indexRegionSize));
+}
 
-    /* 写入数据前，将当前数据索引设置为halfvalid状态 */
-    dataIndex.dataStatus = DATA_HALFVALID;
-    ee_flashWrite(writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+#if EE_USE_BATCH_WRITE
+/**
+ * @brief         一次写入多个数据到flash，所有数据同时生效
+ *
+ * @param pobj    flash管理对象指针
+ * @param items   要写入的数据数组，同一个id出现多次时最后一个有效
+ * @param itemNum 数据个数
+ *
+ * @retval        0: 写入成功
+ *                1: 写入的数据超过索引区
+ *                3: 数据区剩余空间不足
+ *                4: 数据个数超过EE_BATCH_MAX_NUM
+ *
+ * @note          提交之前断电时，批量写入中第一次写入的数据索引停留在invalid状态，
+ *                读取这些数据返回3(而不是2)，再次写入后恢复正常
+ */
+ee_uint8 ee_writeBatchToFlash(ee_flash_t* pobj, ee_batchItem_t* items, ee_uint16 itemNum)
+{
+#if EE_USE_LOCK
+    ee_uint8 ret;
 
-    /* 将真正的数据写入数据区 */
-    ee_flashWrite(pobj->dataStartAddr + dataIndex.dataAddr, (ee_uint8 *)buf, dataIndex.dataSize);
+    ee_writeLock();
+    ret = writeBatch(pobj, items, itemNum);
+    ee_writeUnlock();
 
-    /* 写入后，将当前数据索引设置为valid状态 */
-    dataIndex.dataStatus = DATA_VALID;
-    ee_flashWrite(writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+    return ret;
+#else
+    return writeBatch(pobj, items, itemNum);
+#endif
 }
+
 /**
- * @brief: 获取最后一个没有被重写的索引地址(直接访问地址，不是偏移地址)
+ * @brief: ee_writeBatchToFlash()的实现
  */
-static ee_uint32 getLastIndexAddrThatNotBeenOverwritten(ee_flash_t* pobj, variableLists dataId)
+static ee_uint8 writeBatch(ee_flash_t* pobj, ee_batchItem_t* items, ee_uint16 itemNum)
 {
+    ee_uint8 ret;
+    ee_uint16 i;
     ee_dataIndex dataIndex;
-    ee_uint32 currentIndexAddr;
-    ee_uint32 currentOverwriteAddr;
-    ee_uint32 nextIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+    ee_uint32 overwriteNum = 0;
+    ee_uint32 batchSize = sizeof(ee_uint16) * (itemNum + 1);
+    ee_uint32 batchStartAddr, writeDataAddr, newIndexAddr, trailerAddr;
 
-    do
-    {
-        /* 保存当前索引的地址 */
-        currentIndexAddr = nextIndexAddr;
+    if (itemNum == 0)
+        return 0;
 
-        /* 读下一个数据索引的地址 */
-        ee_flashRead(currentIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
+    if (itemNum > EE_BATCH_MAX_NUM)
+        return 4;
 
-        /* 读取当前索引的重写地址 */
-        currentOverwriteAddr = dataIndex.dataOverwriteAddr;
+    /* 数据区中先存放编号表，后面依次是每个数据 */
+    for (i = 0; i < itemNum; i++)
+        batchSize += items[i].bufSize;
 
-        /* 获取下一个索引的地址 */
-        nextIndexAddr = pobj->overwriteAddr + currentOverwriteAddr;
-    } while (currentOverwriteAddr != (ee_uint16)0xFFFF);
+#if EE_USE_COMPRESS
+    /* 批量写入的数据不压缩，结尾记录中的大小不能占用压缩标志位 */
+    if (batchSize >= DATA_COMPRESSED)
+        return 3;
+#endif
 
-    return currentIndexAddr;
-}
+    ret = planBatch(pobj, items, itemNum, &overwriteNum);
+    if (ret)
+        return ret;
 
-/**
- * @brief: 获取数据区空闲的地址(返回相对于dataStartAddr的偏移地址)
- */
-static ee_uint32 getFreeAddrInDataRegion(ee_flash_t* pobj)
-{
-    ee_uint32 freeAddr = 0;
-    ee_uint32 lastIndexAddr = 0;
-    ee_dataIndex lastDataIndex;
+#if EE_USE_DATA_RING
+    /* 整个批量写入放在数据环的同一个扇区中 */
+    if ((batchSize > SECTOR_SIZE - RING_SECTOR_HEADER_SIZE) || ringAlloc(pobj, (ee_size_t)batchSize, 0))
+        return 3;
 
-    /* 确保变量表中有变量 */
-    if (DATA_NUM != 0)
-        lastIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * (DATA_NUM - 1);
+    /* 回收扇区时可能交换过索引区，重新确定每个数据的索引写在哪里 */
+    planBatch(pobj, items, itemNum, &overwriteNum);
 
-    /* 获取索引区指向数据区最大的地址 */
-    while (lastIndexAddr >= pobj->indexStartAddr)
+    /* 重写区溢出时只交换索引区，数据留在数据环中不动 */
+    if (isBatchOverwriteFull(pobj, overwriteNum))
     {
-        /* 获取索引区最后一个索引的数据 */
-        ee_flashRead(lastIndexAddr, (ee_uint8 *)&lastDataIndex, sizeof(lastDataIndex));
+        swapRegion(pobj);
 
-        /* 如果最后一个数据索引的状态有效，则获得最后一个数据索引数据的地址，否则代表最后一个数据地址无用， 继续从后往前寻找有效的数据索引 */
-        if ((lastDataIndex.dataStatus == DATA_VALID) || (lastDataIndex.dataStatus == DATA_HALFVALID))
-        {
-            /* halfvalid代表我上次在数据区写着写着，你把我单片机给扬喽，因此这块的数据我也不要嘞 */
-            freeAddr = lastDataIndex.dataAddr + lastDataIndex.dataSize;
+        planBatch(pobj, items, itemNum, &overwriteNum);
 
-            break;
-        }
+        if (isBatchOverwriteFull(pobj, overwriteNum))
+            return 3;
+    }
+#else
+    /* 若数据区或重写区放不下整个批量写入 */
+    if (((pobj->dataFreeAddr + batchSize) > SECTORS(pobj->dataRegionSize)) || isBatchOverwriteFull(pobj, overwriteNum))
+    {
+        /* 交换活动空间 */
+        swapRegion(pobj);
 
-        /* 避免(indexStartAddr为0时)减法导致的数据类型溢出 */
-        if (lastIndexAddr == pobj->indexStartAddr)
-            break;
+        /* 活动区已经改变，重新确定每个数据的索引写在哪里 */
+        planBatch(pobj, items, itemNum, &overwriteNum);
 
-        /* 地址递减 */
-        lastIndexAddr -= sizeof(lastDataIndex);
+        if (((pobj->dataFreeAddr + batchSize) > SECTORS(pobj->dataRegionSize)) || isBatchOverwriteFull(pobj, overwriteNum))
+            return 3;
     }
+#endif
 
-    /* 获取重写区空闲的地址 */
-    lastIndexAddr = getFreeAddrInOverwriteArea(pobj);
+    batchStartAddr = pobj->dataFreeAddr;
+    newIndexAddr = pobj->overwriteFreeAddr;
+    trailerAddr = newIndexAddr + sizeof(ee_dataIndex) * overwriteNum;
 
-    /* 如果重写区有重写的数据索引，获取指向数据区最大的地址 */
-    if (lastIndexAddr != pobj->overwriteAddr)
+    /* 重写区的新索引和结尾记录只计数一次 */
+    countAreaAdd(pobj, overwriteNum + 1);
+    pobj->overwriteFreeAddr = trailerAddr + sizeof(ee_dataIndex);
+
+    /* 首先写入结尾记录，它覆盖整个批量写入在数据区占用的空间，写入中途断电时这部分空间不会被重复使用 */
+    dataIndex.dataSize = batchSize;
+    dataIndex.dataAddr = batchStartAddr;
+    dataIndex.dataOverwriteAddr = INDEX_FIELD_EMPTY;
+    flashWrite(pobj, trailerAddr + sizeof(dataIndex.dataStatus), (ee_uint8 *)&dataIndex.dataSize, sizeof(dataIndex) - sizeof(dataIndex.dataStatus));
+
+    dataIndex.dataStatus = DATA_BATCH_OPEN;
+    flashWrite(pobj, trailerAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+
+    /* 先写入每个数据的索引，重写区中的新索引相连，开启写合并时可以合并写入 */
+    writeDataAddr = batchStartAddr + sizeof(ee_uint16) * (itemNum + 1);
+
+    for (i = 0; i < itemNum; i++)
     {
-        /* 定位重写区最后一个数据索引的地址 */
-        lastIndexAddr = lastIndexAddr - sizeof(lastDataIndex);
+        dataIndex.dataSize = items[i].bufSize;
+        dataIndex.dataAddr = writeDataAddr;
+        dataIndex.dataOverwriteAddr = INDEX_FIELD_EMPTY;
 
-        while (lastIndexAddr >= pobj->overwriteAddr)
+        if (INSTANCE_BATCH_IDS(pobj)[i + 1] & BATCH_ID_OVERWRITE)
         {
-            /* 获取重写区最后一个索引的数据 */
-            ee_flashRead(lastIndexAddr, (ee_uint8 *)&lastDataIndex, sizeof(lastDataIndex));
-
-            /* 如果最后一个数据索引的状态处于有效或者半有效状态 */
-            if ((lastDataIndex.dataStatus == DATA_VALID) || (lastDataIndex.dataStatus == DATA_HALFVALID))
-            {
-                /* 重写区最后一个有效的数据索引指向数据区的地址，大于索引区最大指向数据区的地址 */
-                if (freeAddr < (lastDataIndex.dataAddr + lastDataIndex.dataSize))
-                {
-                    /* 说明当前索引指向的地址后面是空闲的数据空间 */
-                    /* 半有效状态，说明在向数据区写入数据时单片机终止运行，这里的做法就是直接抛弃数据区的这一片存储空间 */
-                    freeAddr = lastDataIndex.dataAddr + lastDataIndex.dataSize;
-                }
+            /* 提交之前没有索引指向重写区中的新索引，可以一次写入 */
+            dataIndex.dataStatus = DATA_VALID;
+            flashWriteCombine(pobj, newIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
 
-                break;
-            }
+            newIndexAddr += sizeof(dataIndex);
+        }
+        else
+        {
+            /* 第一次写入的索引在提交之前保持invalid状态 */
+            ee_uint32 writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * items[i].dataId;
 
-            lastIndexAddr -= sizeof(lastDataIndex);
+            dataIndex.dataStatus = DATA_INVALID;
+            flashWrite(pobj, writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+            flashWrite(pobj, writeIndexAddr + sizeof(dataIndex.dataStatus), (ee_uint8 *)&dataIndex.dataSize, sizeof(dataIndex) - sizeof(dataIndex.dataStatus));
         }
+
+        writeDataAddr += items[i].bufSize;
     }
 
-    return freeAddr;
-}
+    /* 写入编号表，提交后断电时通过它找到每个数据的新索引 */
+    flashWriteCombine(pobj, pobj->dataStartAddr + batchStartAddr, (ee_uint8 *)INSTANCE_BATCH_IDS(pobj), sizeof(ee_uint16) * (itemNum + 1));
 
-/**
- * @brief:  重写计数区计数加一
- */
-static void countAreaPlusOne(ee_flash_t* pobj)
-{
-    ee_uint16 i;
-    ee_uint32 addressValue = 0;
-    ee_uint32 countAreaAddr = pobj->overwriteAddr - pobj->overwriteCountAreaSize;
+    /* 编号表后面依次是每个数据，整段数据区是连续写入的 */
+    writeDataAddr = batchStartAddr + sizeof(ee_uint16) * (itemNum + 1);
 
-    for (i = 0; i < pobj->overwriteCountAreaSize; i += 4)
+    for (i = 0; i < itemNum; i++)
     {
-        ee_flashRead(countAreaAddr + i, (ee_uint8 *)&addressValue, sizeof(addressValue));
+        flashWriteCombine(pobj, pobj->dataStartAddr + writeDataAddr, (ee_uint8 *)items[i].buf, items[i].bufSize);
 
-        /* 如果读到的值全是0，代表当前四字节已经被计数满了 */
-        if (addressValue == (ee_uint32)0x00000000)
+        writeDataAddr += items[i].bufSize;
+    }
+
+    /* 提交，此后断电时初始化会让所有数据生效 */
+    dataIndex.dataStatus = DATA_BATCH_COMMIT;
+    flashWrite(pobj, trailerAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+
+    /* 数据区写入游标后移 */
+    pobj->dataFreeAddr = writeDataAddr;
+
+    /* 依次让每个数据的新索引生效 */
+    newIndexAddr = trailerAddr - sizeof(ee_dataIndex) * overwriteNum;
+    writeDataAddr = batchStartAddr + sizeof(ee_uint16) * (itemNum + 1);
+
+    for (i = 0; i < itemNum; i++)
+    {
+        variableLists dataId = items[i].dataId;
+        ee_uint32 lastIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+        ee_uint32 writeIndexAddr = lastIndexAddr;
+
+        if (INSTANCE_BATCH_IDS(pobj)[i + 1] & BATCH_ID_OVERWRITE)
         {
-            /* 读下一个地址 */
-            continue;
+            writeIndexAddr = newIndexAddr;
+            newIndexAddr += sizeof(ee_dataIndex);
+
+#if EE_USE_INDEX_TABLE
+            /* RAM索引表中就是重写链的末尾，不需要遍历 */
+            if (pobj->indexTable[dataId].indexAddr != INDEX_TABLE_NONE)
+                lastIndexAddr = pobj->indexTable[dataId].indexAddr;
+#endif
         }
 
-        /* 来到这里说明四字节里还可以进行计数 */
-        addressValue <<= 1;
+        commitBatchIndex(pobj, dataId, writeIndexAddr, lastIndexAddr);
 
-        /* 将计数写入计数区 */
-        ee_flashWrite(countAreaAddr + i, (ee_uint8 *)&addressValue, sizeof(addressValue));
+#if EE_USE_INDEX_TABLE
+        setIndexTable(pobj, dataId, writeIndexAddr, items[i].bufSize, writeDataAddr);
+#endif
+
+#if EE_USE_READ_CACHE
+        cacheUpdate(pobj, dataId, (ee_uint8 *)items[i].buf, items[i].bufSize);
+#endif
+
+#if INCREMENTAL_SWAP
+        gcMarkDirty(pobj, dataId);
+#endif
+
+#if EE_USE_STATS
+        pobj->stats.logicalBytes += items[i].bufSize;
+#endif
 
-        /* 计数结束 退出*/
-        break;
+        writeDataAddr += items[i].bufSize;
     }
+
+#if EE_USE_CHECKPOINT
+    writeCheckpoint(pobj);
+#endif
+
+    return 0;
 }
 
 /**
- * @brief:  获取重写区空闲的地址(直接访问地址，不是偏移地址)
+ * @brief 检查批量写入的每个数据，并建立编号表(第一次写入的数据索引写在索引区，其余的写在重写区)
+ *
+ * @param poverwriteNum 需要写入重写区的索引个数
+ *
+ * @retval 0: 可以写入 1: 写入的数据超过索引区
  */
-static ee_uint32 getFreeAddrInOverwriteArea(ee_flash_t* pobj)
+static ee_uint8 planBatch(ee_flash_t* pobj, ee_batchItem_t* items, ee_uint16 itemNum, ee_uint32* poverwriteNum)
 {
-    ee_uint16 i;
-    ee_uint16 overwriteCount = 0;
-    ee_uint32 addressValue = 0xFFFFFFFF;
-    ee_uint32 countAreaAddr = pobj->overwriteAddr - pobj->overwriteCountAreaSize;
+    ee_uint16 i, j;
+    ee_size_t dataStatus;
 
-    /* 获取重写区一共重写了多少个数据 */
-    for (i = 0; i < pobj->overwriteCountAreaSize; i += 4)
+    *poverwriteNum = 0;
+    INSTANCE_BATCH_IDS(pobj)[0] = itemNum;
+
+    for (i = 0; i < itemNum; i++)
     {
-        ee_flashRead(countAreaAddr + i, (ee_uint8 *)&addressValue, sizeof(addressValue));
+        variableLists dataId = items[i].dataId;
+        ee_uint32 indexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+        ee_uint8 isWritten = 0;
+
+        /* 写入的数据超过索引区或者不在本实例的数据个数内，直接返回 */
+        if ((indexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize)) || ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj)))
+            return 1;
 
-        /* 获取一个addressValue中0的个数 */
-        if (addressValue != (ee_uint32)0xFFFFFFFF)
+        /* 这个id是否在前面已经写入过 */
+        for (j = 0; j < i; j++)
         {
-            ee_int32 num = addressValue;
+            if (items[j].dataId == dataId)
+                isWritten = 1;
+        }
 
-            while (num + 1)
-            {
-                overwriteCount++;
-                num |= (num + 1);
-            }
+        flashRead(pobj, indexAddr, (ee_uint8 *)&dataStatus, sizeof(dataStatus));
+
+        if (isWritten || (dataStatus != DATA_EMPTY))
+        {
+            INSTANCE_BATCH_IDS(pobj)[i + 1] = (ee_uint16)dataId | BATCH_ID_OVERWRITE;
+            (*poverwriteNum)++;
         }
         else
         {
-            break;
+            INSTANCE_BATCH_IDS(pobj)[i + 1] = (ee_uint16)dataId;
         }
     }
 
-    return (pobj->overwriteAddr + sizeof(ee_dataIndex) * overwriteCount);
+    return 0;
 }
 
 /**
- * @brief: 检查区域是否完全被擦除
- * @retval: 0: region erased, 1: region not erased
+ * @brief: 重写区是否已经放不下批量写入的新索引和结尾记录
  */
-static ee_uint8 verifyRegionFullyErased(ee_flash_t *pobj, ee_uint32 regionAddr)
+static ee_uint8 isBatchOverwriteFull(ee_flash_t* pobj, ee_uint32 overwriteNum)
 {
-    ee_uint8 ret = 0;
-    ee_uint32 addressValue = 0;
-    ee_uint32 regionEndAddr = 0;
+    return (pobj->overwriteFreeAddr + sizeof(ee_dataIndex) * (overwriteNum + 1)) > (pobj->indexStartAddr - 4 + SECTORS(pobj->indexRegionSize));
+}
 
-    /* 获取当前区的结束地址 */
-    if ((pobj->indexStartAddr == regionAddr) || (pobj->indexSwapStartAddr == regionAddr))
+/**
+ * @brief 让批量写入中一个数据的新索引生效
+ *
+ * @param newIndexAddr  新索引的地址，在索引区时说明是第一次写入
+ * @param lastIndexAddr 从这个索引开始查找重写链的末尾
+ */
+static void commitBatchIndex(ee_flash_t* pobj, variableLists dataId, ee_uint32 newIndexAddr, ee_uint32 lastIndexAddr)
+{
+    ee_dataIndex dataIndex;
+
+    if (newIndexAddr == pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId)
     {
-        regionAddr = regionAddr - 4;
+        /* 第一次写入，将索引设置为valid状态 */
+        flashRead(pobj, newIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
 
-        regionEndAddr = regionAddr + SECTORS(pobj->indexRegionSize);
+        if (dataIndex.dataStatus != DATA_VALID)
+        {
+            dataIndex.dataStatus = DATA_VALID;
+            flashWrite(pobj, newIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+        }
+
+        return;
     }
-    else
+
+    /* 找到重写链的末尾，新索引已经在链上说明上次已经生效(断电恢复时) */
+    for (;;)
     {
-        regionEndAddr = regionAddr + SECTORS(pobj->dataRegionSize);
+        if (lastIndexAddr == newIndexAddr)
+            return;
+
+        flashRead(pobj, lastIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
+
+        if (dataIndex.dataOverwriteAddr == INDEX_FIELD_EMPTY)
+            break;
+
+        /* 链上原有的索引都在新索引之前，指向新索引之后说明上次写入重写地址时断电(写入的位只多不少)，重新写入后就是正确的地址 */
+        if (dataIndex.dataOverwriteAddr > newIndexAddr - pobj->overwriteAddr)
+            break;
+
+        lastIndexAddr = pobj->overwriteAddr + dataIndex.dataOverwriteAddr;
     }
 
-    /* Check each active page address starting from end */
-    while (regionAddr < regionEndAddr)
+    /* 将重写链末尾索引的重写地址设置为新索引 */
+    dataIndex.dataOverwriteAddr = newIndexAddr - pobj->overwriteAddr;
+    flashWrite(pobj, lastIndexAddr + sizeof(ee_dataIndex) - sizeof(dataIndex.dataOverwriteAddr), \
+               (ee_uint8 *)&dataIndex.dataOverwriteAddr,                                         \
+               sizeof(dataIndex.dataOverwriteAddr));
+}
+
+/**
+ * @brief: 重写区最后一个记录是已经提交的批量写入时，让其中还没有生效的新索引生效(只在初始化时调用)
+ */
+static void recoverBatch(ee_flash_t* pobj)
+{
+    ee_uint16 i;
+    ee_dataIndex trailer;
+    ee_uint32 trailerAddr = pobj->overwriteFreeAddr - sizeof(ee_dataIndex);
+    ee_uint32 newIndexAddr = trailerAddr;
+
+    if (pobj->overwriteFreeAddr == pobj->overwriteAddr)
+        return;
+
+    flashRead(pobj, trailerAddr, (ee_uint8 *)&trailer, sizeof(trailer));
+
+    /* 没有提交的批量写入不生效，所有数据保持写入前的内容 */
+    if (trailer.dataStatus != DATA_BATCH_COMMIT)
+        return;
+
+    /* 结尾记录覆盖的空间要在数据区内 */
+    if ((trailer.dataAddr > SECTORS(pobj->dataRegionSize)) || (trailer.dataSize > SECTORS(pobj->dataRegionSize) - trailer.dataAddr))
+        return;
+
+    /* 读取编号表 */
+    flashRead(pobj, pobj->dataStartAddr + trailer.dataAddr, (ee_uint8 *)INSTANCE_BATCH_IDS(pobj), sizeof(INSTANCE_BATCH_IDS(pobj)[0]));
+
+    if ((INSTANCE_BATCH_IDS(pobj)[0] > EE_BATCH_MAX_NUM) || (trailer.dataSize < sizeof(INSTANCE_BATCH_IDS(pobj)[0]) * (INSTANCE_BATCH_IDS(pobj)[0] + 1)))
+        return;
+
+    flashRead(pobj, pobj->dataStartAddr + trailer.dataAddr + sizeof(INSTANCE_BATCH_IDS(pobj)[0]), (ee_uint8 *)&INSTANCE_BATCH_IDS(pobj)[1], sizeof(INSTANCE_BATCH_IDS(pobj)[0]) * INSTANCE_BATCH_IDS(pobj)[0]);
+
+    /* 重写区中的新索引依次排列在结尾记录前面，编号表中的数据id和新索引个数不对时不是本实例写入的批量写入，不做恢复 */
+    for (i = 1; i <= INSTANCE_BATCH_IDS(pobj)[0]; i++)
     {
-        /* Get the current location content to be compared with virtual address */
-        ee_flashRead(regionAddr, (ee_uint8 *)&addressValue, sizeof(addressValue));
+        if ((ee_uint32)(INSTANCE_BATCH_IDS(pobj)[i] & (ee_uint16)~BATCH_ID_OVERWRITE) >= INSTANCE_DATA_NUM(pobj))
+            return;
 
-        /* Compare the read address with the virtual address */
-        if (addressValue != (ee_uint32)0xFFFFFFFF)
+        if (INSTANCE_BATCH_IDS(pobj)[i] & BATCH_ID_OVERWRITE)
         {
-            /* In case variable value is read, reset ReadStatus flag */
-            ret = 1;
+            if (newIndexAddr < pobj->overwriteAddr + sizeof(ee_dataIndex))
+                return;
 
-            break;
+            newIndexAddr -= sizeof(ee_dataIndex);
         }
-
-        /* Next address location */
-        regionAddr = regionAddr + sizeof(addressValue);
     }
 
-    /* Return ReadStatus value: (0: region erased, 1: region not erased) */
-    return ret;
+    for (i = 1; i <= INSTANCE_BATCH_IDS(pobj)[0]; i++)
+    {
+        variableLists dataId = (variableLists)(INSTANCE_BATCH_IDS(pobj)[i] & (ee_uint16)~BATCH_ID_OVERWRITE);
+        ee_uint32 indexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+
+        if (INSTANCE_BATCH_IDS(pobj)[i] & BATCH_ID_OVERWRITE)
+        {
+            commitBatchIndex(pobj, dataId, newIndexAddr, indexAddr);
+            newIndexAddr += sizeof(ee_dataIndex);
+        }
+        else
+        {
+            commitBatchIndex(pobj, dataId, indexAddr, indexAddr);
+        }
+    }
 }
+#endif
 
 /**
- * @brief: 擦除一个区域
+ * @brief        从flash读取数据
+ *
+ * @param pobj   flash管理对象指针
+ * @param buf    读取数据的地址
+ * @param dataId 要读取的数据id(详见头文件枚举类型variableLists)
+ *
+ * @retval       0: 读取成功
+ *               1: 读取的数据超过索引区
+ *               2: 当前读取的数据id没有写入过
+ *               3: 当前读取的数据id不是有效的
  */
-static void eraseRegion(ee_flash_t *pobj, ee_uint32 regionAddr)
+ee_uint8 ee_readDataFromFlash(ee_flash_t* pobj, void* buf, variableLists dataId)
 {
-    ee_uint32 regionEndAddr = 0;
+    ee_dataIndex readIndex;
+    ee_size_t dataSize;
+    ee_uint8 ret;
+#if EE_USE_LOCK
+    ee_uint32 seq;
+#endif
+#if EE_USE_READ_CACHE
+    ee_uint16 i;
+    ee_cacheEntry_t* pentry;
 
-    if ((pobj->indexStartAddr == regionAddr) || (pobj->indexSwapStartAddr == regionAddr))
+    /* 先检查id，超出范围的id不能去查找读缓存 */
+    if ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj))
+        return 1;
+
+    /* 读缓存命中，不需要访问flash */
+    pentry = cacheGet(pobj, dataId);
+    if (pentry != 0)
     {
-        /* 索引区(含区域状态，回到最初地址) */
-        regionAddr = regionAddr - 4;
+        for (i = 0; i < pentry->dataSize; i++)
+            ((ee_uint8 *)buf)[i] = pentry->data[i];
 
-        regionEndAddr = regionAddr + SECTORS(pobj->indexRegionSize);
+        return 0;
     }
-    else
+
+    /* 只有这里会把读出的数据放入缓存，未命中只在这里统计 */
+    pobj->cacheMisses++;
+#endif
+
+#if EE_USE_LOCK
+    /* 读取期间写入方交换了区域就重新读取 */
+    do
     {
-        /* 数据区 */
-        regionEndAddr = regionAddr + SECTORS(pobj->dataRegionSize);
+        seq = seqReadBegin(pobj);
+        ret = getLatestIndex(pobj, dataId, &readIndex);
+        if (ret == 0)
+            dataSize = getRecordSize(pobj, &readIndex);
+
+        /* 索引读取期间有修改时大小和地址可能是错的，不能读入用户的缓冲区 */
+        if (seqReadRetry(pobj, seq))
+            continue;
+
+        if (ret)
+            return ret;
+
+        /* 去数据区读数据 */
+        readRecord(pobj, &readIndex, (ee_uint8 *)buf, 0, dataSize);
+    } while (seqReadRetry(pobj, seq));
+#else
+    ret = getLatestIndex(pobj, dataId, &readIndex);
+    if (ret)
+        return ret;
+
+    dataSize = getRecordSize(pobj, &readIndex);
+
+    /* 去数据区读数据 */
+    readRecord(pobj, &readIndex, (ee_uint8 *)buf, 0, dataSize);
+#endif
+
+#if EE_USE_READ_CACHE
+    /* 将读出的数据放入读缓存 */
+    if (dataSize <= EE_READ_CACHE_DATA_SIZE)
+    {
+        pentry = cacheAlloc(pobj, dataId);
+
+        if (pentry != 0)
+        {
+            for (i = 0; i < dataSize; i++)
+                pentry->data[i] = ((ee_uint8 *)buf)[i];
+
+            pentry->dataSize = dataSize;
+        }
     }
+#endif
 
-    while (regionAddr < regionEndAddr)
+    return 0;
+}
+
+/**
+ * @brief        获取数据当前的大小
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要查询的数据id(详见头文件枚举类型variableLists)
+ * @param psize  保存数据大小的地址
+ *
+ * @retval       0: 获取成功
+ *               1: 查询的数据超过索引区
+ *               2: 当前查询的数据id没有写入过
+ *               3: 当前查询的数据id不是有效的
+ */
+ee_uint8 ee_getDataSize(ee_flash_t* pobj, variableLists dataId, ee_size_t* psize)
+{
+    ee_dataIndex readIndex;
+    ee_uint8 ret;
+#if EE_USE_LOCK
+    ee_uint32 seq;
+#endif
+#if EE_USE_READ_CACHE
+    ee_cacheEntry_t* pentry;
+
+    if ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj))
+        return 1;
+
+    pentry = cacheGet(pobj, dataId);
+    if (pentry != 0)
     {
-        ee_flashEraseASector(regionAddr);
+        *psize = pentry->dataSize;
 
-        regionAddr += SECTOR_SIZE;
+        return 0;
     }
+#endif
+
+#if EE_USE_LOCK
+    do
+    {
+        seq = seqReadBegin(pobj);
+        ret = getLatestIndex(pobj, dataId, &readIndex);
+        if (ret == 0)
+            *psize = getRecordSize(pobj, &readIndex);
+    } while (seqReadRetry(pobj, seq));
+
+    return ret;
+#else
+    ret = getLatestIndex(pobj, dataId, &readIndex);
+    if (ret)
+        return ret;
+
+    *psize = getRecordSize(pobj, &readIndex);
+#endif
+
+    return 0;
 }
 
 /**
- * @brief               将数据从活动区搬移到交换区
+ * @brief        从flash读取数据中的一段
  *
- * @param pindex        搬移的索引结构
- * @param newDataAddr   交换数据区的偏移地址
- * @param newIndexAddr  交换索引区的地址
+ * @param pobj   flash管理对象指针
+ * @param buf    读取数据的地址
+ * @param dataId 要读取的数据id(详见头文件枚举类型variableLists)
+ * @param offset 读取的起始位置(相对于数据开头的字节数)
+ * @param len    读取的字节数
+ *
+ * @retval       0: 读取成功
+ *               1: 读取的数据超过索引区
+ *               2: 当前读取的数据id没有写入过
+ *               3: 当前读取的数据id不是有效的
+ *               4: 读取的范围超过了数据的大小
  */
-static void transferDataAndIndex(ee_flash_t* pobj, ee_dataIndex* pindex, ee_uint32* newDataAddr, ee_uint32 newIndexAddr)
+ee_uint8 ee_readDataRange(ee_flash_t* pobj, void* buf, variableLists dataId, ee_size_t offset, ee_size_t len)
 {
-    ee_uint32 i;
-    /* 修改数据在交换区新的地址 */
-    pindex->dataAddr = *newDataAddr;
+    ee_dataIndex readIndex;
+    ee_size_t dataSize;
+    ee_uint8 ret;
+#if EE_USE_LOCK
+    ee_uint32 seq;
+#endif
+#if EE_USE_READ_CACHE
+    ee_uint16 i;
+    ee_cacheEntry_t* pentry;
 
-    /*将索引写入交换区 */
-    ee_flashWrite(newIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
+    if ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj))
+        return 1;
 
-    /* 将数据从活动区中读出，并写入交换数据区 */
-    for (i = 0; i < pindex->dataSize; i++)
+    /* 读缓存命中，从缓存中复制需要的部分 */
+    pentry = cacheGet(pobj, dataId);
+    if (pentry != 0)
     {
-        ee_uint8 data = 0;
+        if ((len > pentry->dataSize) || (offset > pentry->dataSize - len))
+            return 4;
 
-        /* 从满数据区中读出 */
-        ee_flashRead(pobj->dataStartAddr + pindex->dataAddr + i, &data, 1);
+        for (i = 0; i < len; i++)
+            ((ee_uint8 *)buf)[i] = pentry->data[offset + i];
 
-        /* 写入到新交换数据区 */
-        ee_flashWrite(pobj->dataSwapStartAddr + *newDataAddr + i, &data, 1);
+        return 0;
     }
+#endif
 
-    /* 地址递增，用作下一个数据索引的数据区起始地址 */
-    *newDataAddr += i;
+#if EE_USE_LOCK
+    do
+    {
+        seq = seqReadBegin(pobj);
+        ret = getLatestIndex(pobj, dataId, &readIndex);
+        if (ret == 0)
+            dataSize = getRecordSize(pobj, &readIndex);
+
+        if (seqReadRetry(pobj, seq))
+            continue;
+
+        if (ret)
+            return ret;
+
+        if ((len > dataSize) || (offset > dataSize - len))
+            return 4;
+
+        /* 只读出需要的部分 */
+        readRecord(pobj, &readIndex, (ee_uint8 *)buf, offset, len);
+    } while (seqReadRetry(pobj, seq));
+#else
+    ret = getLatestIndex(pobj, dataId, &readIndex);
+    if (ret)
+        return ret;
+
+    dataSize = getRecordSize(pobj, &readIndex);
+    if ((len > dataSize) || (offset > dataSize - len))
+        return 4;
+
+    /* 只读出需要的部分 */
+    readRecord(pobj, &readIndex, (ee_uint8 *)buf, offset, len);
+#endif
+
+    return 0;
 }
 
+#if EE_USE_XIP
 /**
- * @brief 交换区域
+ * @brief        获取直接指向flash中数据的指针
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要读取的数据id(详见头文件枚举类型variableLists)
+ * @param pdata  保存数据指针的地址，指针只能用来读
+ * @param psize  保存数据大小的地址
+ *
+ * @retval       0: 获取成功
+ *               1: 读取的数据超过索引区
+ *               2: 当前读取的数据id没有写入过
+ *               3: 当前读取的数据id不是有效的
+ *               4: 数据是压缩保存的，只能通过ee_readDataFromFlash()读取
  */
-static void swapData(ee_flash_t* pobj)
+ee_uint8 ee_getDataPointer(ee_flash_t* pobj, variableLists dataId, const void** pdata, ee_size_t* psize)
 {
-    ee_uint32 i;
-    ee_uint32 tmp;
-    ee_uint32 regionStatus = 0;
-    ee_uint32 swapRegionAddr = 0;
-
-    /* 在拷贝数据前将交换区状态设置为copy */
-    regionStatus = REGION_COPY;
-    ee_flashWrite(pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+    ee_dataIndex readIndex;
+    ee_uint32 dataAddr;
+    ee_uint8 ret;
+#if EE_USE_LOCK
+    ee_uint32 seq;
 
-    /* 开始将所有数据索引拷贝到交换区域 */
-    for (i = 0; i < DATA_NUM; i++)
+    /* 索引和活动区地址要在同一次读取中得到 */
+    do
     {
-        ee_dataIndex readIndex;
-        ee_uint32 readIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * i;
-        ee_uint32 writeIndexAddr = pobj->indexSwapStartAddr + sizeof(ee_dataIndex) * i;
+        seq = seqReadBegin(pobj);
+        ret = getLatestIndex(pobj, dataId, &readIndex);
+        if (ret == 0)
+            dataAddr = pobj->dataStartAddr + readIndex.dataAddr;
+    } while (seqReadRetry(pobj, seq));
 
-        /* 获取当前数据索引的信息 */
-        ee_flashRead(readIndexAddr, (ee_uint8 *)&readIndex, sizeof(readIndex));
+    if (ret)
+        return ret;
+#else
+    ret = getLatestIndex(pobj, dataId, &readIndex);
+    if (ret)
+        return ret;
 
-        if (readIndex.dataStatus != DATA_EMPTY)
-        {
-            if (readIndex.dataOverwriteAddr != (ee_uint16)0xFFFF)
-            {
-                /* 获取当前索引的最后一个没被重写的地址 */
-                ee_uint32 lastIndexAddr = getLastIndexAddrThatNotBeenOverwritten(pobj, (variableLists)i);
+    dataAddr = pobj->dataStartAddr + readIndex.dataAddr;
+#endif
 
-                /* 获取最后一个重写索引的信息 */
-                ee_flashRead(lastIndexAddr, (ee_uint8 *)&readIndex, sizeof(readIndex));
+#if EE_USE_COMPRESS
+    /* 压缩保存的数据需要解压，不能直接访问 */
+    if (readIndex.dataSize & DATA_COMPRESSED)
+        return 4;
+#endif
 
-                /* 传输数据和索引到交换区 */
-                transferDataAndIndex(pobj, &readIndex, &swapRegionAddr, writeIndexAddr);
-            }
-            else if (readIndex.dataStatus == DATA_VALID)
-            {
-                /* 传输数据和索引到交换区 */
-                transferDataAndIndex(pobj, &readIndex, &swapRegionAddr, writeIndexAddr);
-            }
-        }
+    /* 索引引用的数据一定已经写入flash(写合并缓冲区中只有还没有被引用的数据) */
+    *pdata = (const void *)((const ee_uint8 *)EE_XIP_BASE + dataAddr);
+    *psize = readIndex.dataSize;
+
+    return 0;
+}
+
+/**
+ * @brief      获取数据指针的代数
+ *
+ * @param pobj flash管理对象指针
+ *
+ * @return     代数
+ */
+ee_uint32 ee_getGeneration(ee_flash_t* pobj)
+{
+    return pobj->xipGeneration;
+}
+#endif
+
+/**
+ * @brief: 获取数据最新的索引(开启EE_USE_INDEX_TABLE时只保证dataSize和dataAddr有效)
+ * @retval: 0: 获取成功 1: 数据超过索引区 2: 数据没有写入过 3: 数据不是有效的
+ */
+static ee_uint8 getLatestIndex(ee_flash_t* pobj, variableLists dataId, ee_dataIndex* pindex)
+{
+    ee_uint32 readIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+
+    /* 读取的数据超过索引区或者不在本实例的数据个数内，直接返回 */
+    if ((readIndexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize)) || ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj)))
+        return 1;
+
+#if EE_USE_INDEX_TABLE
+    /* RAM索引表中有当前数据的有效索引，不需要读flash */
+    if (pobj->indexTable[dataId].indexAddr != INDEX_TABLE_NONE)
+    {
+        pindex->dataSize = pobj->indexTable[dataId].dataSize;
+        pindex->dataAddr = pobj->indexTable[dataId].dataAddr;
+
+        return 0;
     }
+#endif
 
-    /* 交换索引活动区 */
-    tmp = pobj->indexStartAddr;
-    pobj->indexStartAddr = pobj->indexSwapStartAddr;
-    pobj->indexSwapStartAddr = tmp;
-    /* 更新重写区在新的活动区的地址 */
-    pobj->overwriteAddr = pobj->indexStartAddr + SECTORS(pobj->indexAreaSize) + pobj->overwriteCountAreaSize;
+    /* 获取当前数据索引的信息 */
+    flashRead(pobj, readIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
 
-    /* 交换数据活动区 */
-    tmp = pobj->dataStartAddr;
-    pobj->dataStartAddr = pobj->dataSwapStartAddr;
-    pobj->dataSwapStartAddr = tmp;
+    /* 数据为空，直接返回 */
+    if (pindex->dataStatus == DATA_EMPTY)
+        return 2;
 
-    /* 下面两条写入状态语句，将活动区的copy变为active，将交换区的active变为erasing
-     * 由于持续时间很短，因此我们认为不会同时出现两个active的情况 */
-    /* 在拷贝数据后将状态设置为active */
-    regionStatus = REGION_ACTIVE;
-    ee_flashWrite(pobj->indexStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+    /* 当前数据被重写了。因为重写索引地址是在重写流程的最后才被赋值的，
+        * 所以程序保证只要数据被重写那么被重写的索引一定是可用的 */
+    if (pindex->dataOverwriteAddr != INDEX_FIELD_EMPTY)
+    {
+        /* 获取最后一个没被重写的索引 */
+        ee_uint32 lastIndexAddr = getLastIndexAddrThatNotBeenOverwritten(pobj, dataId);
 
-    /* 擦除前将状态设置为erasing */
-    regionStatus = REGION_ERASING;
-    ee_flashWrite(pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+        /* 获取最后一个重写索引的信息 */
+        flashRead(pobj, lastIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
+    }
+    else if (pindex->dataStatus != DATA_VALID)
+    {
+        /* 来到这里说明当前索引的数据不是有效的，同时还没有被重写过(或者重写失败了) */
+        return 3;
+    }
 
-    /* 擦除交换区 */
-    eraseRegion(pobj, pobj->indexSwapStartAddr);
-    eraseRegion(pobj, pobj->dataSwapStartAddr);
+    return 0;
 }
 
 /**
- * @brief: 当数据区溢出或者数据索引区溢出时，都需要进行调换活动区
- * 索引区溢出或数据区溢出：调换数据区和数据索引区的活动区(最初想法如果只有索引区溢出只交换索引区
- * 这个方案可行但是会导致拥有4个区域状态，导致初始化代码复杂)
+ * @brief: 获取数据的原始大小(压缩保存的数据从数据开头读出原始大小)
  */
-static void swapRegion(ee_flash_t* pobj)
+static ee_size_t getRecordSize(ee_flash_t* pobj, ee_dataIndex* pindex)
 {
-    ee_uint32 regionStatus = 0;
+#if EE_USE_COMPRESS
+    ee_size_t rawSize;
 
-    /* 读交换区的状态 */
-    ee_flashRead(pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+    if (pindex->dataSize & DATA_COMPRESSED)
+    {
+        flashRead(pobj, pobj->dataStartAddr + pindex->dataAddr, (ee_uint8 *)&rawSize, sizeof(rawSize));
 
-    switch (regionStatus)
+        return rawSize;
+    }
+#else
+    (void)pobj;
+#endif
+
+    return pindex->dataSize;
+}
+
+/**
+ * @brief: 读出数据中[offset, offset + len)这一段，压缩保存的数据边读边解压(调用前需要保证不超过数据的原始大小)
+ */
+static void readRecord(ee_flash_t* pobj, ee_dataIndex* pindex, ee_uint8* buf, ee_size_t offset, ee_size_t len)
+{
+    ee_uint32 dataAddr = pobj->dataStartAddr + pindex->dataAddr;
+
+#if EE_USE_COMPRESS
+    if (pindex->dataSize & DATA_COMPRESSED)
     {
-		/* 发现当前区域active, 交换区状态为copy，说明在拷贝数据时单片机终止运行 */
-		/* 发现当前区域active, 交换区状态为active，说明数据拷贝完，但是还没开始擦除的情况 */
-		/* 发现当前区域active, 交换区状态为erasing，说明区域可能被擦除了也可能在擦除时被终止了，因此都需要先验证是否完全被擦除 */
-		case REGION_COPY: 
-		case REGION_ACTIVE:
-		case REGION_ERASING:
-			if (verifyRegionFullyErased(pobj, pobj->indexSwapStartAddr) || \
-			    verifyRegionFullyErased(pobj, pobj->dataSwapStartAddr))
-			{
-				/* 如果验证块没有被完全擦除则进行块的擦除 */
-				/* 如果在擦除时，单片机复位，区的状态还是处于erased */
-				eraseRegion(pobj, pobj->indexSwapStartAddr);
-				eraseRegion(pobj, pobj->dataSwapStartAddr);
-			}
+        decompressData(pobj, dataAddr + sizeof(ee_size_t), RECORD_SIZE(pindex->dataSize) - sizeof(ee_size_t), buf, offset, len);
+        return;
+    }
+#endif
 
-			/* 将区的状态设置为verified */
-			regionStatus = REGION_VERIFIED;
-			ee_flashWrite(pobj->indexSwapStartAddr - 4, (ee_uint8*)&regionStatus, 4);
+    flashRead(pobj, dataAddr + offset, buf, len);
+}
 
-			/* 验证状态之间进行交换 */
-		case REGION_VERIFIED:
-			/* 交换索引区 */
-			swapData(pobj);
-			break;
-	}
+#if EE_USE_COMPRESS
+/**
+ * @brief 游程编码压缩数据，控制字节最高位为0时后面跟着(控制字节 + 1)个原样的字节，
+ *        最高位为1时后面的一个字节重复((控制字节 & 0x7F) + 3)次
+ *
+ * @param dstSize 压缩缓冲区的大小
+ *
+ * @retval 压缩后的大小，压缩缓冲区放不下时返回0
+ */
+static ee_uint32 compressData(ee_uint8* src, ee_size_t srcSize, ee_uint8* dst, ee_uint32 dstSize)
+{
+    ee_uint32 i = 0, literalStart = 0, outLen = 0;
+    ee_uint32 runLen, n;
+
+    while (1)
+    {
+        /* 从i开始重复的字节个数 */
+        runLen = 0;
+        if (i < srcSize)
+        {
+            runLen = 1;
+            while ((i + runLen < srcSize) && (src[i + runLen] == src[i]) && (runLen < 0x7F + 3))
+                runLen++;
+        }
+
+        /* 重复次数太少时当作原样的字节 */
+        if ((i < srcSize) && (runLen < 3))
+        {
+            i++;
+            continue;
+        }
+
+        /* 先输出前面原样的字节 */
+        while (literalStart < i)
+        {
+            n = i - literalStart;
+            if (n > 0x7F + 1)
+                n = 0x7F + 1;
+
+            if (outLen + 1 + n > dstSize)
+                return 0;
+
+            dst[outLen++] = (ee_uint8)(n - 1);
+            while (n--)
+                dst[outLen++] = src[literalStart++];
+        }
+
+        if (i >= srcSize)
+            break;
+
+        if (outLen + 2 > dstSize)
+            return 0;
+
+        dst[outLen++] = (ee_uint8)(0x80 + runLen - 3);
+        dst[outLen++] = src[i];
+
+        i += runLen;
+        literalStart = i;
+    }
+
+    return outLen;
+}
+
+/**
+ * @brief 边读边解压flash中压缩保存的数据，只输出原始数据中[offset, offset + len)这一段
+ *
+ * @param flashAddr  压缩数据的地址(原始大小之后)
+ * @param streamSize 压缩数据的大小
+ */
+static void decompressData(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint32 streamSize, ee_uint8* buf, ee_size_t offset, ee_size_t len)
+{
+    ee_uint8 code[2];
+    ee_uint32 endAddr = flashAddr + streamSize;
+    ee_uint32 pos = 0, outEnd = (ee_uint32)offset + len;
+    ee_uint32 n, from, to;
+
+    /* 每段至少2字节：控制字节和重复的字节(或第一个原样的字节) */
+    while ((pos < outEnd) && (flashAddr + 2 <= endAddr))
+    {
+        flashRead(pobj, flashAddr, code, 2);
+
+        n = (code[0] & 0x80) ? ((ee_uint32)(code[0] & 0x7F) + 3) : ((ee_uint32)code[0] + 1);
+
+        /* 这一段和需要输出的部分重叠的范围 */
+        from = (pos > offset) ? pos : offset;
+        to = (pos + n < outEnd) ? (pos + n) : outEnd;
+
+        if (code[0] & 0x80)
+        {
+            for (; from < to; from++)
+                buf[from - offset] = code[1];
+
+            flashAddr += 2;
+        }
+        else
+        {
+            /* 只读出需要的原样字节，压缩数据不完整时停止 */
+            if (flashAddr + 1 + n > endAddr)
+                break;
+
+            if (from < to)
+                flashRead(pobj, flashAddr + 1 + (from - pos), buf + (from - offset), to - from);
+
+            flashAddr += 1 + n;
+        }
+
+        pos += n;
+    }
+}
+#endif
+
+#if EE_USE_INCREMENTAL_GC
+/**
+ * @brief        执行一步垃圾回收，适合在空闲时周期调用
+ *
+ * @param pobj   flash管理对象指针
+ * @param budget 本次最多执行的工作量，每个单位为检查并擦除一个扇区、拷贝一个数据或回收一个数据环扇区
+ *
+ * @retval       0: 当前没有需要进行的回收工作
+ *               1: 回收工作还没有完成
+ */
+ee_uint8 ee_gcStep(ee_flash_t* pobj, ee_uint16 budget)
+{
+#if EE_USE_LOCK
+    ee_uint8 ret;
+
+    ee_writeLock();
+    ret = gcStep(pobj, budget);
+    ee_writeUnlock();
+
+    return ret;
+#else
+    return gcStep(pobj, budget);
+#endif
+}
+
+/**
+ * @brief: ee_gcStep()的实现
+ */
+static ee_uint8 gcStep(ee_flash_t* pobj, ee_uint16 budget)
+{
+#if !EE_USE_DATA_RING
+    ee_uint8 ret;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    /* 上一次启动的擦除还没有完成，直接返回，不在这里等待 */
+    if (ee_isBusy(pobj))
+        return 1;
+#endif
+
+#if EE_USE_DATA_RING
+    /* 数据环每次回收最旧的一个扇区 */
+    while (ringNeedGc(pobj))
+    {
+        if (budget == 0)
+            return 1;
+
+        budget--;
+
+        if (ringReclaimSector(pobj))
+            return 0;
+
+#if EE_USE_ASYNC_ERASE
+        /* 回收的扇区正在擦除，下次调用再继续 */
+        if (pobj->eraseBusy)
+            return 1;
+#endif
+    }
+
+    return 0;
+#else
+#if EE_USE_STATS
+    statsGcBegin(pobj);
+#endif
+
+    ret = gcAdvance(pobj, budget, 0);
+
+#if EE_USE_WRITE_COMBINE
+    /* 返回前将拷贝的数据写入flash，不留在写合并缓冲区中 */
+    flashWriteFlush(pobj);
+#endif
+
+#if EE_USE_STATS
+    statsGcEnd(pobj);
+#endif
+
+    return ret;
+#endif
+}
+
+#if EE_USE_ASYNC_ERASE
+/**
+ * @brief        查询ee_gcStep()启动的擦除是否还在进行，擦除期间调用其他接口会等待擦除完成
+ *
+ * @param pobj   flash管理对象指针
+ *
+ * @retval       0: 没有正在进行的擦除
+ *               1: 擦除还在进行
+ */
+ee_uint8 ee_isBusy(ee_flash_t* pobj)
+{
+    if (pobj->eraseBusy && ee_flashIsBusy())
+        return 1;
+
+    pobj->eraseBusy = 0;
+
+    return 0;
+}
+#endif
+
+#if EE_USE_ASYNC_WRITE
+/**
+ * @brief         启动一次写入后立即返回，之后调用ee_poll()完成写入
+ *
+ * @param pobj    flash管理对象指针
+ * @param phandle 这次写入的句柄，由调用者分配
+ * @param buf     写入数据的地址
+ * @param bufSize 数据大小
+ * @param dataId  要写入的数据id(详见头文件枚举类型variableLists)
+ *
+ * @retval        0: 已经登记，等待ee_poll()完成
+ *                1: 写入的数据超过索引区
+ *                4: 开启EE_USE_COMPRESS时数据大小占用了压缩标志位(超过ee_size_t最大值的一半)
+ */
+ee_uint8 ee_writeStart(ee_flash_t* pobj, ee_writeHandle_t* phandle, void* buf, ee_size_t bufSize, variableLists dataId)
+{
+    phandle->dataId = dataId;
+    phandle->buf = buf;
+    phandle->bufSize = bufSize;
+    phandle->result = EE_WRITE_PENDING;
+
+    /* 与ee_writeDataToFlash()相同的检查，不访问flash */
+    (void)pobj;
+    if ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj))
+        phandle->result = 1;
+#if EE_USE_COMPRESS
+    else if (bufSize & DATA_COMPRESSED)
+        phandle->result = 4;
+#endif
+
+    return (phandle->result == EE_WRITE_PENDING) ? 0 : phandle->result;
+}
+
+/**
+ * @brief         推进ee_writeStart()启动的写入，不等待擦除完成
+ *
+ * @param pobj    flash管理对象指针
+ * @param phandle ee_writeStart()使用的句柄
+ *
+ * @retval        EE_WRITE_PENDING: 还没有完成(擦除还在进行或者正在回收空间)，之后再次调用
+ *                其他: 已经完成，返回值与ee_writeDataToFlash()相同
+ */
+ee_uint8 ee_poll(ee_flash_t* pobj, ee_writeHandle_t* phandle)
+{
+#if EE_USE_LOCK
+    ee_uint8 ret;
+
+    ee_writeLock();
+    ret = pollWrite(pobj, phandle);
+    ee_writeUnlock();
+
+    return ret;
+#else
+    return pollWrite(pobj, phandle);
+#endif
+}
+
+/**
+ * @brief: ee_poll()的实现
+ */
+static ee_uint8 pollWrite(ee_flash_t* pobj, ee_writeHandle_t* phandle)
+{
+    if (phandle->result != EE_WRITE_PENDING)
+        return phandle->result;
+
+    /* 擦除还在进行，写入会等待擦除完成，下次调用再继续 */
+    if (ee_isBusy(pobj))
+        return EE_WRITE_PENDING;
+
+    /* 活动区放不下时先推进一步增量回收，擦除交换区的扇区时只启动擦除；
+     * 回收状态回到GC_IDLE时交换区已经擦除，之后写入中同步完成的交换不会再擦除扇区 */
+    if (writeNeedsSwap(pobj, phandle->bufSize, phandle->dataId) && gcStep(pobj, 1))
+        return EE_WRITE_PENDING;
+
+    phandle->result = writeData(pobj, phandle->buf, phandle->bufSize, phandle->dataId);
+
+    return phandle->result;
+}
+
+/**
+ * @brief: 按ee_writeDataToFlash()交换活动区的条件判断写入前是否需要交换(压缩保存的数据按原始大小判断)
+ */
+static ee_uint8 writeNeedsSwap(ee_flash_t* pobj, ee_size_t bufSize, variableLists dataId)
+{
+    ee_dataIndex currentdataIndex;
+    ee_uint32 writeIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+
+    if ((pobj->dataFreeAddr + RECORD_SIZE(bufSize)) > SECTORS(pobj->dataRegionSize))
+        return 1;
+
+    /* 超过索引区的数据由writeData()返回错误 */
+    if (writeIndexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
+        return 0;
+
+    flashRead(pobj, writeIndexAddr, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
+
+    return (currentdataIndex.dataStatus != DATA_EMPTY) && isOverwriteAreaFull(pobj);
+}
+#endif
+#endif
+
+#if EE_USE_READ_CACHE
+/**
+ * @brief        将数据读入读缓存并锁定，之后不会被淘汰(需要在ee_flashInit之后调用)
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要锁定的数据id(详见头文件枚举类型variableLists)
+ *
+ * @retval       0: 锁定成功
+ *               1: 数据超过索引区
+ *               2: 当前数据id没有写入过
+ *               3: 当前数据id不是有效的
+ *               4: 数据大于EE_READ_CACHE_DATA_SIZE，或者所有缓存项都已经被锁定
+ */
+ee_uint8 ee_pinDataInCache(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_dataIndex readIndex;
+    ee_size_t dataSize;
+    ee_uint8 ret;
+    ee_cacheEntry_t* pentry;
+
+    if ((ee_uint32)dataId >= INSTANCE_DATA_NUM(pobj))
+        return 1;
+
+    /* 数据还不在缓存中，先读入缓存 */
+    pentry = cacheFind(pobj, dataId);
+    if (pentry == 0)
+    {
+        ret = getLatestIndex(pobj, dataId, &readIndex);
+        if (ret)
+            return ret;
+
+        dataSize = getRecordSize(pobj, &readIndex);
+        if (dataSize > EE_READ_CACHE_DATA_SIZE)
+            return 4;
+
+        pentry = cacheAlloc(pobj, dataId);
+        if (pentry == 0)
+            return 4;
+
+        readRecord(pobj, &readIndex, pentry->data, 0, dataSize);
+        pentry->dataSize = dataSize;
+    }
+
+    pentry->pinned = 1;
+
+    return 0;
+}
+
+/**
+ * @brief        解除数据在读缓存中的锁定，数据仍然保留在缓存中
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要解除锁定的数据id(详见头文件枚举类型variableLists)
+ */
+void ee_unpinDataInCache(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_cacheEntry_t* pentry = cacheFind(pobj, dataId);
+
+    if (pentry != 0)
+        pentry->pinned = 0;
+}
+
+/**
+ * @brief         获取读缓存的命中和未命中次数(从ee_flashInit开始)
+ *
+ * @param pobj    flash管理对象指针
+ * @param phits   保存命中次数的地址
+ * @param pmisses 保存未命中次数的地址
+ */
+void ee_getCacheStats(ee_flash_t* pobj, ee_uint32* phits, ee_uint32* pmisses)
+{
+    *phits = pobj->cacheHits;
+    *pmisses = pobj->cacheMisses;
+}
+
+/**
+ * @brief: 在读缓存中查找数据，没有找到时返回NULL
+ */
+static ee_cacheEntry_t* cacheFind(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_uint16 i;
+
+    for (i = 0; i < EE_READ_CACHE_NUM; i++)
+    {
+        if (pobj->cache[i].used && (pobj->cache[i].dataId == (ee_uint16)dataId))
+            return &pobj->cache[i];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief: 读取数据时查找读缓存，命中时统计命中次数并记录最后一次读取的时间
+ * @note:  未命中由会把数据放入缓存的ee_readDataFromFlash()统计
+ */
+static ee_cacheEntry_t* cacheGet(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_cacheEntry_t* pentry = cacheFind(pobj, dataId);
+
+    if (pentry == 0)
+        return 0;
+
+    pobj->cacheHits++;
+    pentry->lastUse = ++pobj->cacheTick;
+
+    return pentry;
+}
+
+/**
+ * @brief: 为数据分配一个缓存项，优先使用空闲项，否则淘汰最久没有读取且没有被锁定的一项
+ * @retval: 分配的缓存项(数据由调用者填入)，所有缓存项都被锁定时返回NULL
+ */
+static ee_cacheEntry_t* cacheAlloc(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_uint16 i;
+    ee_cacheEntry_t* pentry = 0;
+
+    for (i = 0; i < EE_READ_CACHE_NUM; i++)
+    {
+        ee_cacheEntry_t* pcur = &pobj->cache[i];
+
+        if (!pcur->used)
+        {
+            pentry = pcur;
+            break;
+        }
+
+        /* 按距离现在的计数比较，计数溢出后仍然正确 */
+        if (!pcur->pinned && ((pentry == 0) || \
+            ((ee_uint32)(pobj->cacheTick - pcur->lastUse) > (ee_uint32)(pobj->cacheTick - pentry->lastUse))))
+        {
+            pentry = pcur;
+        }
+    }
+
+    if (pentry != 0)
+    {
+        pentry->dataId = (ee_uint16)dataId;
+        pentry->used = 1;
+        pentry->pinned = 0;
+        pentry->lastUse = ++pobj->cacheTick;
+    }
+
+    return pentry;
+}
+
+/**
+ * @brief: 写入数据后更新读缓存，新数据放不下时删除这一项(即使被锁定)
+ */
+static void cacheUpdate(ee_flash_t* pobj, variableLists dataId, ee_uint8* buf, ee_size_t bufSize)
+{
+    ee_uint16 i;
+    ee_cacheEntry_t* pentry = cacheFind(pobj, dataId);
+
+    if (pentry == 0)
+        return;
+
+    if (bufSize > EE_READ_CACHE_DATA_SIZE)
+    {
+        pentry->used = 0;
+        pentry->pinned = 0;
+        return;
+    }
+
+    for (i = 0; i < bufSize; i++)
+        pentry->data[i] = buf[i];
+
+    pentry->dataSize = bufSize;
+}
+#endif
+
+#if EE_USE_OP_COUNTER
+/**
+ * @brief          获取flash驱动操作统计
+ *
+ * @param pobj     flash管理对象指针
+ * @param pcounter 保存统计结果的地址
+ */
+void ee_getOpCounter(ee_flash_t* pobj, ee_opCounter_t* pcounter)
+{
+    *pcounter = pobj->opCounter;
+}
+
+/**
+ * @brief      清零flash驱动操作统计
+ *
+ * @param pobj flash管理对象指针
+ */
+void ee_clearOpCounter(ee_flash_t* pobj)
+{
+    pobj->opCounter.readCount = 0;
+    pobj->opCounter.readBytes = 0;
+    pobj->opCounter.writeCount = 0;
+    pobj->opCounter.writeBytes = 0;
+    pobj->opCounter.eraseCount = 0;
+}
+#endif
+
+#if EE_USE_STATS
+/**
+ * @brief        获取写放大和磨损统计
+ *
+ * @param pobj   flash管理对象指针
+ * @param pstats 保存统计结果的地址
+ */
+void ee_getStats(ee_flash_t* pobj, ee_stats_t* pstats)
+{
+    *pstats = pobj->stats;
+}
+
+/**
+ * @brief        设置写放大和磨损统计
+ *
+ * @param pobj   flash管理对象指针
+ * @param pstats 统计结果的地址，为NULL时清零
+ */
+void ee_setStats(ee_flash_t* pobj, ee_stats_t* pstats)
+{
+    ee_uint16 i;
+
+    if (pstats != 0)
+    {
+        pobj->stats = *pstats;
+        return;
+    }
+
+    pobj->stats.logicalBytes = 0;
+    pobj->stats.physicalBytes = 0;
+    pobj->stats.gcBytes = 0;
+    pobj->stats.gcCount = 0;
+    pobj->stats.gcTicks = 0;
+
+    for (i = 0; i < EE_STATS_SECTOR_NUM; i++)
+        pobj->stats.eraseCount[i] = 0;
+}
+
+/**
+ * @brief: 回收开始，可以嵌套(数据环回收扇区时可能交换索引区)，只统计最外层的耗时
+ */
+static void statsGcBegin(ee_flash_t* pobj)
+{
+    if (pobj->statsGcDepth++ == 0)
+        pobj->statsGcStart = ee_getTick();
+}
+
+/**
+ * @brief: 回收结束
+ */
+static void statsGcEnd(ee_flash_t* pobj)
+{
+    if (--pobj->statsGcDepth == 0)
+        pobj->stats.gcTicks += (ee_uint32)ee_getTick() - pobj->statsGcStart;
+}
+
+/**
+ * @brief: 记录擦除的扇区，扇区编号不随活动区交换改变
+ */
+static void statsErase(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint16 sectorNum)
+{
+    ee_uint32 slot;
+    ee_uint32 indexLowAddr, indexHighAddr, dataLowAddr, dataHighAddr;
+
+    /* 索引区的首地址前有4字节区域状态 */
+    indexLowAddr = ((pobj->indexStartAddr < pobj->indexSwapStartAddr) ? pobj->indexStartAddr : pobj->indexSwapStartAddr) - 4;
+    indexHighAddr = ((pobj->indexStartAddr < pobj->indexSwapStartAddr) ? pobj->indexSwapStartAddr : pobj->indexStartAddr) - 4;
+    dataLowAddr = (pobj->dataStartAddr < pobj->dataSwapStartAddr) ? pobj->dataStartAddr : pobj->dataSwapStartAddr;
+    dataHighAddr = (pobj->dataStartAddr < pobj->dataSwapStartAddr) ? pobj->dataSwapStartAddr : pobj->dataStartAddr;
+
+    for (; sectorNum > 0; sectorNum--, flashAddr += SECTOR_SIZE)
+    {
+        if ((flashAddr >= indexLowAddr) && (flashAddr < indexLowAddr + SECTORS(pobj->indexRegionSize)))
+            slot = (flashAddr - indexLowAddr) / SECTOR_SIZE;
+        else if ((flashAddr >= indexHighAddr) && (flashAddr < indexHighAddr + SECTORS(pobj->indexRegionSize)))
+            slot = pobj->indexRegionSize + (flashAddr - indexHighAddr) / SECTOR_SIZE;
+        else if ((flashAddr >= dataLowAddr) && (flashAddr < dataLowAddr + SECTORS(pobj->dataRegionSize)))
+            slot = 2 * pobj->indexRegionSize + (flashAddr - dataLowAddr) / SECTOR_SIZE;
+        else if ((flashAddr >= dataHighAddr) && (flashAddr < dataHighAddr + SECTORS(pobj->dataRegionSize)))
+            slot = 2 * pobj->indexRegionSize + pobj->dataRegionSize + (flashAddr - dataHighAddr) / SECTOR_SIZE;
+        else
+            continue;
+
+        if (slot < EE_STATS_SECTOR_NUM)
+            pobj->stats.eraseCount[slot]++;
+    }
+}
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+/**
+ * @brief         设置存储实例的驱动函数和数据个数
+ *
+ * @param pobj    flash管理对象指针
+ * @param pdriver 本实例的驱动函数
+ * @param dataNum 本实例的数据个数
+ */
+void ee_setInstance(ee_flash_t* pobj, ee_flashDriver_t* pdriver, ee_uint16 dataNum)
+{
+    /* RAM索引表等按DATA_NUM分配，不能超过 */
+    if (dataNum > DATA_NUM)
+        dataNum = DATA_NUM;
+
+    pobj->driver = pdriver;
+    pobj->dataNum = dataNum;
+}
+#endif
+
+/**
+ * @brief: 所有flash写操作的入口
+ */
+static void flashWrite(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num)
+{
+#if EE_USE_WRITE_COMBINE
+    ee_uint32 len;
+#endif
+
+#if EE_USE_WIDE_INDEX
+    /* 驱动函数一次最多操作0xFFFF字节，大数据分成多次 */
+    while (num > 0x8000)
+    {
+        flashWrite(pobj, flashAddr, buf, 0x8000);
+        flashAddr += 0x8000;
+        buf += 0x8000;
+        num -= 0x8000;
+    }
+#endif
+
+#if EE_USE_WRITE_COMBINE
+    /* 状态和索引的写入有先后顺序，先把之前合并的数据写入flash */
+    flashWriteFlush(pobj);
+
+    /* 跨页的索引分成两次写入 */
+    len = FLASH_PAGE_SIZE - flashAddr % FLASH_PAGE_SIZE;
+    if (len < num)
+    {
+        flashWrite(pobj, flashAddr, buf, len);
+        flashWrite(pobj, flashAddr + len, buf + len, num - len);
+        return;
+    }
+#endif
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.writeCount++;
+    pobj->opCounter.writeBytes += num;
+#endif
+
+#if EE_USE_STATS
+    pobj->stats.physicalBytes += num;
+    if (pobj->statsGcDepth)
+        pobj->stats.gcBytes += num;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    flashWaitReady(pobj);
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+    pobj->driver->write(flashAddr, buf, num);
+#elif EE_USE_STRIPE
+    (void)pobj;
+    stripeWrite(flashAddr, buf, num);
+#else
+    (void)pobj;
+    ee_flashWrite(flashAddr, buf, num);
+#endif
+}
+
+/**
+ * @brief: 可以合并的flash写操作的入口，用于写入还没有被任何状态或索引引用的数据
+ * @note:  合并的数据在下一次普通写入、擦除或读取到它时写入flash，因此调用后一定还要有一次普通写入
+ */
+static void flashWriteCombine(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num)
+{
+#if EE_USE_WRITE_COMBINE
+    ee_uint16 i, len;
+
+    while (num > 0)
+    {
+        /* 不和缓冲区中的数据相连，或者已经到了下一页，先将缓冲区写入flash */
+        if ((pobj->combineLen != 0) && ((flashAddr != pobj->combineAddr + pobj->combineLen) || ((flashAddr % FLASH_PAGE_SIZE) == 0)))
+            flashWriteFlush(pobj);
+
+        if (pobj->combineLen == 0)
+            pobj->combineAddr = flashAddr;
+
+        /* 每次只放到当前页的末尾 */
+        len = FLASH_PAGE_SIZE - flashAddr % FLASH_PAGE_SIZE;
+        if (len > num)
+            len = num;
+
+        for (i = 0; i < len; i++)
+            pobj->combineBuffer[pobj->combineLen + i] = buf[i];
+
+        pobj->combineLen += len;
+        flashAddr += len;
+        buf += len;
+        num -= len;
+    }
+#else
+    flashWrite(pobj, flashAddr, buf, num);
+#endif
+}
+
+#if EE_USE_WRITE_COMBINE
+/**
+ * @brief: 将写合并缓冲区中的数据写入flash
+ */
+static void flashWriteFlush(ee_flash_t* pobj)
+{
+    if (pobj->combineLen == 0)
+        return;
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.writeCount++;
+    pobj->opCounter.writeBytes += pobj->combineLen;
+#endif
+
+#if EE_USE_STATS
+    pobj->stats.physicalBytes += pobj->combineLen;
+    if (pobj->statsGcDepth)
+        pobj->stats.gcBytes += pobj->combineLen;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    flashWaitReady(pobj);
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+    pobj->driver->write(pobj->combineAddr, pobj->combineBuffer, pobj->combineLen);
+#elif EE_USE_STRIPE
+    stripeWrite(pobj->combineAddr, pobj->combineBuffer, pobj->combineLen);
+#else
+    ee_flashWrite(pobj->combineAddr, pobj->combineBuffer, pobj->combineLen);
+#endif
+
+    pobj->combineLen = 0;
+}
+#endif
+
+/**
+ * @brief: 所有flash读操作的入口
+ */
+static void flashRead(ee_flash_t* pobj, ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num)
+{
+#if EE_USE_WIDE_INDEX
+    /* 驱动函数一次最多操作0xFFFF字节，大数据分成多次 */
+    while (num > 0x8000)
+    {
+        flashRead(pobj, flashAddr, buf, 0x8000);
+        flashAddr += 0x8000;
+        buf += 0x8000;
+        num -= 0x8000;
+    }
+#endif
+
+#if EE_USE_WRITE_COMBINE
+    /* 读取的范围和还没有写入的合并数据重叠 */
+    if ((pobj->combineLen != 0) && (flashAddr < pobj->combineAddr + pobj->combineLen) && (flashAddr + num > pobj->combineAddr))
+        flashWriteFlush(pobj);
+#endif
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.readCount++;
+    pobj->opCounter.readBytes += num;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    flashWaitReady(pobj);
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+    pobj->driver->read(flashAddr, buf, num);
+#elif EE_USE_STRIPE
+    (void)pobj;
+    stripeRead(flashAddr, buf, num);
+#else
+    (void)pobj;
+    ee_flashRead(flashAddr, buf, num);
+#endif
+}
+
+/**
+ * @brief: 所有flash扇区擦除操作的入口
+ */
+static void flashEraseSector(ee_flash_t* pobj, ee_uint32 flashAddr)
+{
+#if EE_USE_WRITE_COMBINE
+    flashWriteFlush(pobj);
+#endif
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.eraseCount++;
+#endif
+
+#if EE_USE_STATS
+    statsErase(pobj, flashAddr, 1);
+#endif
+
+#if EE_USE_XIP
+    /* 擦除前改变代数，之前通过ee_getDataPointer()得到的指针可能失效 */
+    pobj->xipGeneration++;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    flashWaitReady(pobj);
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+    pobj->driver->eraseSector(flashAddr);
+#elif EE_USE_STRIPE
+    (void)pobj;
+    stripeEraseSector(flashAddr);
+#else
+    (void)pobj;
+    ee_flashEraseASector(flashAddr);
+#endif
+}
+
+#if EE_USE_STRIPE
+/**
+ * @brief: 按页把写入分到两片flash上，一片flash在写入时另一片可以同时写入下一页
+ * @note:  返回前等待两片flash都写完，之后写入的状态和索引一定在这些数据之后写入flash
+ */
+static void stripeWrite(ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num)
+{
+    ee_uint32 len;
+    ee_uint8 dev;
+
+    while (num > 0)
+    {
+        len = FLASH_PAGE_SIZE - flashAddr % FLASH_PAGE_SIZE;
+        if (len > num)
+            len = num;
+
+        /* 只等待这一页所在的flash写完上一页 */
+        dev = STRIPE_DEV(flashAddr);
+        while (ee_stripeIsBusy(dev))
+            ;
+
+        ee_stripeWriteStart(dev, STRIPE_ADDR(flashAddr), buf, (ee_uint16)len);
+
+        flashAddr += len;
+        buf += len;
+        num -= len;
+    }
+
+    while (ee_stripeIsBusy(0) || ee_stripeIsBusy(1))
+        ;
+}
+
+/**
+ * @brief: 按页从两片flash中读出数据
+ */
+static void stripeRead(ee_uint32 flashAddr, ee_uint8* buf, ee_uint32 num)
+{
+    ee_uint32 len;
+
+    while (num > 0)
+    {
+        len = FLASH_PAGE_SIZE - flashAddr % FLASH_PAGE_SIZE;
+        if (len > num)
+            len = num;
+
+        ee_stripeRead(STRIPE_DEV(flashAddr), STRIPE_ADDR(flashAddr), buf, (ee_uint16)len);
+
+        flashAddr += len;
+        buf += len;
+        num -= len;
+    }
+}
+
+/**
+ * @brief: 擦除一个扇区，两片flash同时擦除各自的一半
+ */
+static void stripeEraseSector(ee_uint32 flashAddr)
+{
+    ee_stripeEraseStart(0, STRIPE_ADDR(flashAddr));
+    ee_stripeEraseStart(1, STRIPE_ADDR(flashAddr));
+
+    while (ee_stripeIsBusy(0) || ee_stripeIsBusy(1))
+        ;
+}
+#endif
+
+#if EE_USE_LOCK
+/**
+ * @brief: 写操作开始修改读操作会用到的状态(RAM索引表、活动区地址)，序号变为奇数(可以嵌套)
+ */
+static void seqWriteBegin(ee_flash_t* pobj)
+{
+    if (pobj->seqDepth++ == 0)
+    {
+        pobj->seq++;
+        ee_memoryBarrier();
+    }
+}
+
+/**
+ * @brief: 修改完成，序号变回偶数
+ */
+static void seqWriteEnd(ee_flash_t* pobj)
+{
+    if (--pobj->seqDepth == 0)
+    {
+        ee_memoryBarrier();
+        pobj->seq++;
+    }
+}
+
+/**
+ * @brief: 读操作开始前等待正在进行的修改完成，返回当前序号
+ */
+static ee_uint32 seqReadBegin(ee_flash_t* pobj)
+{
+    ee_uint32 seq;
+
+    while ((seq = pobj->seq) & 1)
+        ee_readYield();
+
+    ee_memoryBarrier();
+
+    return seq;
+}
+
+/**
+ * @brief: 读操作结束后检查序号，读取期间有修改时返回1
+ */
+static ee_uint8 seqReadRetry(ee_flash_t* pobj, ee_uint32 seq)
+{
+    ee_memoryBarrier();
+
+    return pobj->seq != seq;
+}
+#endif
+
+#if EE_USE_ASYNC_ERASE
+/**
+ * @brief: 启动一个扇区的擦除后立即返回，之后的flash操作会先等待擦除完成
+ */
+static void flashEraseSectorAsync(ee_flash_t* pobj, ee_uint32 flashAddr)
+{
+#if EE_USE_WRITE_COMBINE
+    flashWriteFlush(pobj);
+#endif
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.eraseCount++;
+#endif
+
+#if EE_USE_STATS
+    statsErase(pobj, flashAddr, 1);
+#endif
+
+#if EE_USE_XIP
+    /* 擦除前改变代数，之前通过ee_getDataPointer()得到的指针可能失效 */
+    pobj->xipGeneration++;
+#endif
+
+    flashWaitReady(pobj);
+
+    ee_flashEraseASectorStart(flashAddr);
+
+    pobj->eraseBusy = 1;
+}
+
+/**
+ * @brief: 等待异步擦除完成
+ */
+static void flashWaitReady(ee_flash_t* pobj)
+{
+    if (!pobj->eraseBusy)
+        return;
+
+    while (ee_flashIsBusy())
+        ;
+
+    pobj->eraseBusy = 0;
+}
+#endif
+
+#ifdef ee_flashEraseABlock
+/**
+ * @brief: 所有flash块擦除操作的入口
+ */
+static void flashEraseBlock(ee_flash_t* pobj, ee_uint32 flashAddr)
+{
+#if EE_USE_WRITE_COMBINE
+    flashWriteFlush(pobj);
+#endif
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.eraseCount++;
+#endif
+
+#if EE_USE_STATS
+    statsErase(pobj, flashAddr, BLOCk_SECTOR_NUM);
+#endif
+
+#if EE_USE_XIP
+    /* 擦除前改变代数，之前通过ee_getDataPointer()得到的指针可能失效 */
+    pobj->xipGeneration++;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    flashWaitReady(pobj);
+#endif
+
+    ee_flashEraseABlock(flashAddr);
+}
+#endif
+
+/**
+ * @brief 将索引结构和数据写入flash
+ *
+ * @param writeDataAddr 将要写入的数据区目的地址
+ * @param writeIndexAddr 将要希尔的索引区地址
+ * @param buf 写入数据的指针，为NULL时从flash的srcFlashAddr处搬运数据
+ * @param srcFlashAddr 搬运数据的flash地址(buf为NULL时有效)
+ * @param bufSize 写入数据的大小
+ */
+static void writeIndexAndData(ee_flash_t* pobj, ee_uint32 writeDataAddr, ee_uint32 writeIndexAddr, void* buf, ee_uint32 srcFlashAddr, ee_size_t bufSize)
+{
+    ee_dataIndex dataIndex;
+    /* 写入前，先将当前数据索引设置为invalid状态 */
+    dataIndex.dataStatus = DATA_INVALID;
+
+    /* 写入当前状态 */
+    flashWrite(pobj, writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+
+    /* 现在将剩余结构成员写入 */
+    dataIndex.dataSize = bufSize;
+    dataIndex.dataAddr = writeDataAddr;
+    dataIndex.dataOverwriteAddr = INDEX_FIELD_EMPTY;
+    flashWrite(pobj, writeIndexAddr + sizeof(dataIndex.dataStatus), (ee_uint8 *)&dataIndex.dataSize, sizeof(dataIndex) - sizeof(dataIndex.dataStatus));
+
+    /* 写入数据前，将当前数据索引设置为halfvalid状态 */
+    dataIndex.dataStatus = DATA_HALFVALID;
+    flashWrite(pobj, writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+
+    /* 将真正的数据写入数据区 */
+    writeRecordData(pobj, writeDataAddr, buf, srcFlashAddr, bufSize);
+
+    /* 写入后，将当前数据索引设置为valid状态 */
+    dataIndex.dataStatus = DATA_VALID;
+    flashWrite(pobj, writeIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex.dataStatus));
+}
+
+/**
+ * @brief 将一条数据写入数据区(调用后一定还要写入它的状态或链接，写合并缓冲区中的数据随之写入flash)
+ *
+ * @param writeDataAddr 将要写入的数据区目的地址(相对于dataStartAddr的偏移地址)
+ * @param buf 写入数据的指针，为NULL时从flash的srcFlashAddr处搬运数据
+ * @param srcFlashAddr 搬运数据的flash地址(buf为NULL时有效)
+ * @param bufSize 索引中的数据大小(压缩保存时带有压缩标志)
+ */
+static void writeRecordData(ee_flash_t* pobj, ee_uint32 writeDataAddr, void* buf, ee_uint32 srcFlashAddr, ee_size_t bufSize)
+{
+    if (buf != 0)
+        flashWriteCombine(pobj, pobj->dataStartAddr + writeDataAddr, (ee_uint8 *)buf, RECORD_SIZE(bufSize));
+    else
+        copyFlashData(pobj, srcFlashAddr, pobj->dataStartAddr + writeDataAddr, RECORD_SIZE(bufSize));
+}
+/**
+ * @brief: 获取最后一个没有被重写的索引地址(直接访问地址，不是偏移地址)
+ */
+static ee_uint32 getLastIndexAddrThatNotBeenOverwritten(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_dataIndex dataIndex;
+    ee_uint32 currentIndexAddr;
+    ee_uint32 nextIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+
+    do
+    {
+        /* 保存当前索引的地址 */
+        currentIndexAddr = nextIndexAddr;
+
+        /* 读下一个数据索引的地址 */
+        flashRead(pobj, currentIndexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
+
+        /* 获取下一个索引的地址 */
+        nextIndexAddr = getNextIndexAddr(pobj, dataIndex.dataOverwriteAddr);
+    } while (nextIndexAddr != 0);
+
+    return currentIndexAddr;
+}
+
+/**
+ * @brief: 由索引的重写地址得到下一个索引的地址(直接访问地址)
+ * @note:  写入重写地址时断电，写了一部分的重写地址只会比正确的地址多一些1，它不对齐或者指向重写区写入游标之后，
+ *         这样的重写地址当作没有被重写(初始化时由repairOverwriteLink()修复)，不会读到重写区之外
+ * @retval: 下一个索引的地址，没有被重写或者重写地址无效时返回0
+ */
+static ee_uint32 getNextIndexAddr(ee_flash_t* pobj, ee_size_t overwriteAddr)
+{
+    if ((overwriteAddr == INDEX_FIELD_EMPTY) || ((overwriteAddr % sizeof(ee_dataIndex)) != 0) || \
+        (overwriteAddr >= pobj->overwriteFreeAddr - pobj->overwriteAddr))
+        return 0;
+
+    return pobj->overwriteAddr + overwriteAddr;
+}
+
+/**
+ * @brief: 上次写入重写地址时断电，重新写入正确的重写地址(只在初始化时调用)
+ * @note:  重写一个数据时最后才写入上一个索引的重写地址，它指向重写区最后一个索引，而且这时最后一个索引已经是valid状态。
+ *         写了一部分的重写地址只会比正确的地址多一些1，因此无效并且包含正确地址所有的0，再写一次正确的地址(只能把1变成0)就恢复了
+ *         批量写入的重写地址由recoverBatch()修复
+ */
+static void repairOverwriteLink(ee_flash_t* pobj)
+{
+    ee_uint32 i, j, num, area, indexNum, areaAddr;
+    ee_size_t linkAddr;
+    ee_dataIndex lastIndex;
+
+    if (pobj->overwriteFreeAddr == pobj->overwriteAddr)
+        return;
+
+    flashRead(pobj, pobj->overwriteFreeAddr - sizeof(ee_dataIndex), (ee_uint8 *)&lastIndex, sizeof(lastIndex));
+
+    /* 最后一个索引还没有写完，还没有开始写入重写地址 */
+    if (lastIndex.dataStatus != DATA_VALID)
+        return;
+
+    linkAddr = (ee_size_t)(pobj->overwriteFreeAddr - sizeof(ee_dataIndex) - pobj->overwriteAddr);
+
+    /* 依次检查索引区和重写区(最后一个索引之前)中的索引，通过缓冲区成块读出 */
+    for (area = 0; area < 2; area++)
+    {
+        if (area == 0)
+        {
+            areaAddr = pobj->indexStartAddr;
+            indexNum = (pobj->overwriteAddr - pobj->overwriteCountAreaSize - pobj->indexStartAddr) / sizeof(ee_dataIndex);
+            if (indexNum > INSTANCE_DATA_NUM(pobj))
+                indexNum = INSTANCE_DATA_NUM(pobj);
+        }
+        else
+        {
+            areaAddr = pobj->overwriteAddr;
+            indexNum = linkAddr / sizeof(ee_dataIndex);
+        }
+
+        for (i = 0; i < indexNum; i += num)
+        {
+            num = indexNum - i;
+            if (num > sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex))
+                num = sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex);
+
+            flashRead(pobj, areaAddr + sizeof(ee_dataIndex) * i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), sizeof(ee_dataIndex) * num);
+
+            for (j = 0; j < num; j++)
+            {
+                ee_dataIndex *pindex = (ee_dataIndex *)INSTANCE_COPY_BUF(pobj) + j;
+
+                /* 检查点记录中保存的不是重写地址 */
+                if ((pindex->dataStatus == DATA_CHECKPOINT_BODY) || (pindex->dataOverwriteAddr == INDEX_FIELD_EMPTY) || \
+                    (pindex->dataOverwriteAddr == linkAddr) || ((pindex->dataOverwriteAddr & linkAddr) != linkAddr) || \
+                    (getNextIndexAddr(pobj, pindex->dataOverwriteAddr) != 0))
+                    continue;
+
+                flashWrite(pobj, areaAddr + sizeof(ee_dataIndex) * (i + j + 1) - sizeof(linkAddr), (ee_uint8 *)&linkAddr, sizeof(linkAddr));
+
+                return;
+            }
+        }
+    }
+}
+
+#if !EE_USE_DATA_RING
+/**
+ * @brief: 获取数据区空闲的地址(返回相对于dataStartAddr的偏移地址)
+ * @note:  需要重写区写入游标已经恢复，只在初始化时调用
+ */
+static ee_uint32 getFreeAddrInDataRegion(ee_flash_t* pobj)
+{
+    ee_uint32 i, j, num;
+    ee_uint32 freeAddr = 0;
+    ee_uint32 lastIndexAddr = 0;
+    ee_uint32 indexNum = (pobj->overwriteAddr - pobj->overwriteCountAreaSize - pobj->indexStartAddr) / sizeof(ee_dataIndex);
+    ee_dataIndex lastDataIndex;
+
+    /* 只有变量表中的数据可能被写入 */
+    if (indexNum > INSTANCE_DATA_NUM(pobj))
+        indexNum = INSTANCE_DATA_NUM(pobj);
+
+    /* 数据可以按任意顺序第一次写入，索引区中每个索引都可能指向数据区最大的地址，通过缓冲区成块读出索引区 */
+    for (i = 0; i < indexNum; i += num)
+    {
+        num = indexNum - i;
+        if (num > sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex))
+            num = sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex);
+
+        flashRead(pobj, pobj->indexStartAddr + sizeof(ee_dataIndex) * i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), sizeof(ee_dataIndex) * num);
+
+        for (j = 0; j < num; j++)
+        {
+            ee_dataIndex *pindex = (ee_dataIndex *)INSTANCE_COPY_BUF(pobj) + j;
+
+            /* halfvalid代表我上次在数据区写着写着，你把我单片机给扬喽，因此这块的数据我也不要嘞 */
+            if (DATA_STATUS_WRITTEN(pindex->dataStatus) && \
+                (freeAddr < getIndexDataEnd(pindex)))
+            {
+                freeAddr = getIndexDataEnd(pindex);
+            }
+        }
+    }
+
+    /* 获取重写区空闲的地址 */
+    lastIndexAddr = pobj->overwriteFreeAddr;
+
+    /* 如果重写区有重写的数据索引，获取指向数据区最大的地址 */
+    if (lastIndexAddr != pobj->overwriteAddr)
+    {
+        /* 定位重写区最后一个数据索引的地址 */
+        lastIndexAddr = lastIndexAddr - sizeof(lastDataIndex);
+
+        while (lastIndexAddr >= pobj->overwriteAddr)
+        {
+            /* 获取重写区最后一个索引的数据 */
+            flashRead(pobj, lastIndexAddr, (ee_uint8 *)&lastDataIndex, sizeof(lastDataIndex));
+
+            /* 检查点之前的索引都不会超过检查点记录的数据区写入游标 */
+            if (lastDataIndex.dataStatus == DATA_CHECKPOINT)
+            {
+                if (freeAddr < lastDataIndex.dataAddr)
+                    freeAddr = lastDataIndex.dataAddr;
+
+                break;
+            }
+
+            /* 如果最后一个数据索引的状态处于有效或者半有效状态(批量写入的结尾记录覆盖了整个批量写入的数据) */
+            if (DATA_STATUS_WRITTEN(lastDataIndex.dataStatus) || DATA_STATUS_TRAILER(lastDataIndex.dataStatus))
+            {
+                /* 重写区最后一个有效的数据索引指向数据区的地址，大于索引区最大指向数据区的地址 */
+                if (freeAddr < getIndexDataEnd(&lastDataIndex))
+                {
+                    /* 说明当前索引指向的地址后面是空闲的数据空间 */
+                    /* 半有效状态，说明在向数据区写入数据时单片机终止运行，这里的做法就是直接抛弃数据区的这一片存储空间 */
+                    freeAddr = getIndexDataEnd(&lastDataIndex);
+                }
+
+                break;
+            }
+
+            lastIndexAddr -= sizeof(lastDataIndex);
+        }
+    }
+
+    /* 写入中途断电的索引可能指向数据区之外，此时当作数据区已满，下一次写入时交换 */
+    if (freeAddr > SECTORS(pobj->dataRegionSize))
+        freeAddr = SECTORS(pobj->dataRegionSize);
+
+    return freeAddr;
+}
+#endif
+
+/**
+ * @brief: 获取索引指向的数据在数据区的结束地址，写入中途断电的索引相加溢出时返回最大值
+ */
+static ee_uint32 getIndexDataEnd(ee_dataIndex* pindex)
+{
+    ee_uint32 endAddr = (ee_uint32)pindex->dataAddr + RECORD_SIZE(pindex->dataSize);
+
+    if (endAddr < pindex->dataAddr)
+        endAddr = 0xFFFFFFFF;
+
+    return endAddr;
+}
+
+/**
+ * @brief:  重写计数区计数加num(计数值由重写区写入游标得到，不需要读flash)，每个计数字只写一次
+ */
+static void countAreaAdd(ee_flash_t* pobj, ee_uint32 num)
+{
+    ee_uint32 overwriteCount = (pobj->overwriteFreeAddr - pobj->overwriteAddr) / sizeof(ee_dataIndex);
+    ee_uint32 endCount = overwriteCount + num;
+
+    while (overwriteCount < endCount)
+    {
+        ee_uint32 countAreaAddr = pobj->overwriteAddr - pobj->overwriteCountAreaSize + (overwriteCount / 32) * 4;
+        ee_uint32 bitNum = endCount - (overwriteCount / 32) * 32;
+        ee_uint32 addressValue;
+
+        /* 计数区已经计满 */
+        if (countAreaAddr >= pobj->overwriteAddr)
+            return;
+
+        /* 每计数一次，四字节中从低位开始多一个0 */
+        addressValue = (bitNum >= 32) ? (ee_uint32)0x00000000 : ((ee_uint32)0xFFFFFFFF << bitNum);
+
+        /* 将计数写入计数区 */
+        flashWrite(pobj, countAreaAddr, (ee_uint8 *)&addressValue, sizeof(addressValue));
+
+        overwriteCount = (overwriteCount / 32 + 1) * 32;
+    }
+}
+
+/**
+ * @brief:  获取重写区空闲的地址(直接访问地址，不是偏移地址)
+ */
+static ee_uint32 getFreeAddrInOverwriteArea(ee_flash_t* pobj)
+{
+    ee_uint32 low = 0;
+    ee_uint32 high = pobj->overwriteCountAreaSize / 4;
+    ee_uint32 overwriteCount;
+    ee_uint32 addressValue = 0xFFFFFFFF;
+    ee_uint32 countAreaAddr = pobj->overwriteAddr - pobj->overwriteCountAreaSize;
+
+    /* 计数区按顺序一个字一个字地计满，二分查找第一个没有计满(不为0)的计数字 */
+    while (low < high)
+    {
+        ee_uint32 mid = (low + high) / 2;
+
+        flashRead(pobj, countAreaAddr + mid * 4, (ee_uint8 *)&addressValue, sizeof(addressValue));
+
+        if (addressValue == (ee_uint32)0x00000000)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    /* 前面的计数字都已经计满，再加上这个计数字中0的个数 */
+    overwriteCount = low * 32;
+
+    if (low < (ee_uint32)(pobj->overwriteCountAreaSize / 4))
+    {
+        flashRead(pobj, countAreaAddr + low * 4, (ee_uint8 *)&addressValue, sizeof(addressValue));
+
+        overwriteCount += countZeroBits(addressValue);
+    }
+
+    return (pobj->overwriteAddr + sizeof(ee_dataIndex) * overwriteCount);
+}
+
+/**
+ * @brief: 计算一个计数字中0的个数
+ */
+static ee_uint8 countZeroBits(ee_uint32 value)
+{
+#if defined(__GNUC__)
+    return (ee_uint8)__builtin_popcountl((unsigned long)(ee_uint32)~value);
+#else
+    value = ~value;
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    value = (value + (value >> 4)) & 0x0F0F0F0F;
+
+    return (ee_uint8)(((value * 0x01010101) & 0xFFFFFFFF) >> 24);
+#endif
+}
+
+/**
+ * @brief: 检查区域是否完全被擦除
+ * @retval: 0: region erased, 1: region not erased
+ */
+static ee_uint8 verifyRegionFullyErased(ee_flash_t *pobj, ee_uint32 regionAddr)
+{
+    ee_uint32 regionEndAddr = 0;
+
+    /* 获取当前区的结束地址 */
+    if ((pobj->indexStartAddr == regionAddr) || (pobj->indexSwapStartAddr == regionAddr))
+    {
+        regionAddr = regionAddr - 4;
+
+        regionEndAddr = regionAddr + SECTORS(pobj->indexRegionSize);
+    }
+    else
+    {
+        regionEndAddr = regionAddr + SECTORS(pobj->dataRegionSize);
+    }
+
+    return verifyRangeErased(pobj, regionAddr, regionEndAddr);
+}
+
+/**
+ * @brief: 检查[startAddr, endAddr)是否完全被擦除
+ * @retval: 0: range erased, 1: range not erased
+ */
+static ee_uint8 verifyRangeErased(ee_flash_t *pobj, ee_uint32 startAddr, ee_uint32 endAddr)
+{
+#ifdef ee_flashBlankCheck
+    if (startAddr >= endAddr)
+        return 0;
+
+#if EE_USE_WRITE_COMBINE
+    /* 还没有写入的合并数据也要参与检查 */
+    flashWriteFlush(pobj);
+#endif
+
+#if EE_USE_OP_COUNTER
+    pobj->opCounter.readCount++;
+    pobj->opCounter.readBytes += endAddr - startAddr;
+#endif
+
+#if EE_USE_ASYNC_ERASE
+    flashWaitReady(pobj);
+#endif
+
+    return ee_flashBlankCheck(startAddr, endAddr - startAddr) ? 1 : 0;
+#else
+    ee_uint32 i, len;
+
+    /* 通过缓冲区成块读出比较，范围不是4字节的整数倍时，最后不足4字节的部分逐字节比较 */
+    while (startAddr < endAddr)
+    {
+        len = endAddr - startAddr;
+        if (len > sizeof(INSTANCE_COPY_BUF(pobj)))
+            len = sizeof(INSTANCE_COPY_BUF(pobj));
+
+        flashRead(pobj, startAddr, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), len);
+
+        for (i = 0; i < len / 4; i++)
+        {
+            if (INSTANCE_COPY_BUF(pobj)[i] != (ee_uint32)0xFFFFFFFF)
+                return 1;
+        }
+
+        for (i = len & ~(ee_uint32)0x03; i < len; i++)
+        {
+            if (((ee_uint8 *)INSTANCE_COPY_BUF(pobj))[i] != 0xFF)
+                return 1;
+        }
+
+        startAddr += len;
+    }
+
+    return 0;
+#endif
+}
+
+/**
+ * @brief: 读区域状态
+ * @note:  写入状态时断电，状态可能只写了一部分：它介于写入前和要写入的状态之间(包含写入前状态所有的0和要写入状态所有的1)，
+ *         这时当作写入前的状态，初始化时会重新进行这一步。其他无法识别的值原样返回
+ */
+static ee_uint32 readRegionStatus(ee_flash_t *pobj, ee_uint32 regionAddr)
+{
+    static const ee_uint32 regionStates[] = {REGION_ERASING, REGION_VERIFIED, REGION_COPY, REGION_ACTIVE, REGION_OBSOLETE};
+    ee_uint32 i, status;
+
+    flashRead(pobj, regionAddr, (ee_uint8 *)&status, 4);
+
+    for (i = 0; i + 1 < sizeof(regionStates) / sizeof(regionStates[0]); i++)
+    {
+        if (status == regionStates[i + 1])
+            break;
+
+        if (((status | regionStates[i]) == regionStates[i]) && ((status & regionStates[i + 1]) == regionStates[i + 1]))
+            return regionStates[i];
+    }
+
+    return status;
+}
+
+/**
+ * @brief: 擦除一个区域
+ */
+static void eraseRegion(ee_flash_t *pobj, ee_uint32 regionAddr)
+{
+    ee_uint32 regionEndAddr = 0;
+
+    if ((pobj->indexStartAddr == regionAddr) || (pobj->indexSwapStartAddr == regionAddr))
+    {
+        /* 索引区(含区域状态，回到最初地址) */
+        regionAddr = regionAddr - 4;
+
+        regionEndAddr = regionAddr + SECTORS(pobj->indexRegionSize);
+    }
+    else
+    {
+        /* 数据区 */
+        regionEndAddr = regionAddr + SECTORS(pobj->dataRegionSize);
+    }
+
+    while (regionAddr < regionEndAddr)
+    {
+#ifdef ee_flashEraseABlock
+        /* 按块对齐并且剩余部分至少有一个块时整块擦除 */
+        if (((regionAddr % BLOCKS(1)) == 0) && ((regionEndAddr - regionAddr) >= BLOCKS(1)))
+        {
+            flashEraseBlock(pobj, regionAddr);
+
+            regionAddr += BLOCKS(1);
+            continue;
+        }
+#endif
+
+        flashEraseSector(pobj, regionAddr);
+
+        regionAddr += SECTOR_SIZE;
+    }
+}
+
+/**
+ * @brief               将数据从活动区搬移到交换区
+ *
+ * @param pindex        搬移的索引结构
+ * @param newDataAddr   交换数据区的偏移地址
+ * @param newIndexAddr  交换索引区的地址
+ */
+static void transferDataAndIndex(ee_flash_t* pobj, ee_dataIndex* pindex, ee_uint32* newDataAddr, ee_uint32 newIndexAddr)
+{
+#if EE_USE_DATA_RING
+    /* 数据环中的数据不随索引区交换，只拷贝索引 */
+    (void)newDataAddr;
+
+    flashWrite(pobj, newIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
+#else
+    ee_uint32 oldDataAddr = pindex->dataAddr;
+
+    /* 修改数据在交换区新的地址 */
+    pindex->dataAddr = *newDataAddr;
+
+    /*将索引写入交换区 */
+    flashWrite(pobj, newIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
+
+    /* 将数据从满数据区(注意是旧的地址)搬到新交换数据区 */
+    copyFlashData(pobj, pobj->dataStartAddr + oldDataAddr, pobj->dataSwapStartAddr + *newDataAddr, RECORD_SIZE(pindex->dataSize));
+
+    /* 地址递增，用作下一个数据索引的数据区起始地址 */
+    *newDataAddr += RECORD_SIZE(pindex->dataSize);
+#endif
+}
+
+/**
+ * @brief: 通过缓冲区将flash中的数据成块搬移到另一个地址，每次写入不跨越flash页
+ */
+static void copyFlashData(ee_flash_t* pobj, ee_uint32 srcAddr, ee_uint32 dstAddr, ee_uint32 size)
+{
+    ee_uint32 i, len;
+
+    for (i = 0; i < size; i += len)
+    {
+        len = size - i;
+        if (len > EE_COPY_BUF_SIZE)
+            len = EE_COPY_BUF_SIZE;
+        if (len > FLASH_PAGE_SIZE - (dstAddr + i) % FLASH_PAGE_SIZE)
+            len = FLASH_PAGE_SIZE - (dstAddr + i) % FLASH_PAGE_SIZE;
+
+        flashRead(pobj, srcAddr + i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), len);
+
+        flashWriteCombine(pobj, dstAddr + i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), len);
+    }
+}
+
+/**
+ * @brief: 交换区拷贝完成后，将交换区切换为活动区
+ *
+ * @param dataFreeAddr      新活动区的数据区写入游标
+ * @param overwriteUsedSize 新活动区的重写区已经使用的字节数
+ */
+static void activateSwapRegion(ee_flash_t* pobj, ee_uint32 dataFreeAddr, ee_uint32 overwriteUsedSize)
+{
+    ee_uint32 tmp;
+    ee_uint32 regionStatus = 0;
+
+    /* 先将旧的活动区设置为obsolete，再将交换区的copy变为active
+     * 两次写入之间断电时，初始化发现obsolete和copy就知道拷贝已经完成，不会出现两个active的情况 */
+    regionStatus = REGION_OBSOLETE;
+    flashWrite(pobj, pobj->indexStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+
+    regionStatus = REGION_ACTIVE;
+    flashWrite(pobj, pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+
+    /* 交换索引活动区 */
+    tmp = pobj->indexStartAddr;
+    pobj->indexStartAddr = pobj->indexSwapStartAddr;
+    pobj->indexSwapStartAddr = tmp;
+    /* 更新重写区在新的活动区的地址 */
+    pobj->overwriteAddr = pobj->indexStartAddr + SECTORS(pobj->indexAreaSize) + pobj->overwriteCountAreaSize;
+
+#if !EE_USE_DATA_RING
+    /* 交换数据活动区(数据环不交换) */
+    tmp = pobj->dataStartAddr;
+    pobj->dataStartAddr = pobj->dataSwapStartAddr;
+    pobj->dataSwapStartAddr = tmp;
+#endif
+
+    pobj->dataFreeAddr = dataFreeAddr;
+    pobj->overwriteFreeAddr = pobj->overwriteAddr + overwriteUsedSize;
+
+#if EE_USE_CHECKPOINT
+    /* 交换后每个数据的重写链都从头开始，从这里重新计算到下一个检查点的索引个数 */
+    pobj->checkpointAddr = pobj->overwriteFreeAddr;
+#endif
+
+#if EE_USE_STATS
+    pobj->stats.gcCount++;
+#endif
+}
+
+#if !INCREMENTAL_SWAP
+/**
+ * @brief: 将一个数据的最新索引拷贝到交换区(非数据环模式同时搬运数据)
+ *
+ * @param newDataAddr 交换数据区的偏移地址，拷贝后递增
+ * @param pindex      保存拷贝到交换区的索引
+ *
+ * @retval: 0: 当前数据没有有效的索引 1: 拷贝成功
+ */
+static ee_uint8 transferLatestRecord(ee_flash_t* pobj, variableLists dataId, ee_uint32* newDataAddr, ee_dataIndex* pindex)
+{
+    ee_uint32 readIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+    ee_uint32 writeIndexAddr = pobj->indexSwapStartAddr + sizeof(ee_dataIndex) * dataId;
+
+    /* 获取当前数据索引的信息 */
+    flashRead(pobj, readIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
+
+    if (pindex->dataStatus == DATA_EMPTY)
+        return 0;
+
+    if (pindex->dataOverwriteAddr != INDEX_FIELD_EMPTY)
+    {
+        /* 获取当前索引的最后一个没被重写的地址 */
+        ee_uint32 lastIndexAddr = getLastIndexAddrThatNotBeenOverwritten(pobj, dataId);
+
+        /* 获取最后一个重写索引的信息 */
+        flashRead(pobj, lastIndexAddr, (ee_uint8 *)pindex, sizeof(ee_dataIndex));
+    }
+    else if (pindex->dataStatus != DATA_VALID)
+    {
+        return 0;
+    }
+
+    /* 传输数据和索引到交换区 */
+    transferDataAndIndex(pobj, pindex, newDataAddr, writeIndexAddr);
+
+    return 1;
+}
+
+/**
+ * @brief 交换区域
+ */
+static void swapData(ee_flash_t* pobj)
+{
+    ee_uint32 i;
+    ee_uint32 regionStatus = 0;
+    ee_uint32 swapRegionAddr = 0;
+
+    /* 在拷贝数据前将交换区状态设置为copy */
+    regionStatus = REGION_COPY;
+    flashWrite(pobj, pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+
+    /* 开始将所有数据索引拷贝到交换区域 */
+    for (i = 0; i < INSTANCE_DATA_NUM(pobj); i++)
+    {
+        ee_dataIndex readIndex;
+
+        if (transferLatestRecord(pobj, (variableLists)i, &swapRegionAddr, &readIndex))
+        {
+#if EE_USE_INDEX_TABLE
+            /* RAM索引表指向交换区中的新索引 */
+            setIndexTable(pobj, (variableLists)i, pobj->indexSwapStartAddr + sizeof(ee_dataIndex) * i, readIndex.dataSize, readIndex.dataAddr);
+#endif
+        }
+#if EE_USE_INDEX_TABLE
+        else
+        {
+            pobj->indexTable[i].indexAddr = INDEX_TABLE_NONE;
+        }
+#endif
+    }
+
+#if EE_USE_DATA_RING
+    /* 数据环不交换，数据区写入游标不变 */
+    activateSwapRegion(pobj, pobj->dataFreeAddr, 0);
+#else
+    /* 新活动区中数据紧密排列，重写区为空 */
+    activateSwapRegion(pobj, swapRegionAddr, 0);
+#endif
+
+    /* 擦除交换区 */
+    eraseRegion(pobj, pobj->indexSwapStartAddr);
+#if !EE_USE_DATA_RING
+    eraseRegion(pobj, pobj->dataSwapStartAddr);
+#endif
+}
+#endif
+
+/**
+ * @brief: 当数据区溢出或者数据索引区溢出时，都需要进行调换活动区
+ * 索引区溢出或数据区溢出：调换数据区和数据索引区的活动区(最初想法如果只有索引区溢出只交换索引区
+ * 这个方案可行但是会导致拥有4个区域状态，导致初始化代码复杂)
+ */
+static void swapRegion(ee_flash_t* pobj)
+{
+#if EE_USE_STATS
+    statsGcBegin(pobj);
+#endif
+
+#if INCREMENTAL_SWAP
+    /* 活动区已经写满，同步完成剩余的回收工作，旧活动区的擦除仍然留给ee_gcStep() */
+    gcAdvance(pobj, 0, 1);
+#else
+    ee_uint32 regionStatus = 0;
+
+#if EE_USE_LOCK
+    /* 交换期间RAM索引表会先指向交换区，读操作等待交换完成 */
+    seqWriteBegin(pobj);
+#endif
+
+    /* 读交换区的状态 */
+    regionStatus = readRegionStatus(pobj, pobj->indexSwapStartAddr - 4);
+
+    switch (regionStatus)
+    {
+		/* 发现当前区域active, 交换区状态为copy，说明在拷贝数据时单片机终止运行 */
+		/* 发现当前区域active, 交换区状态为active，说明数据拷贝完，但是还没开始擦除的情况 */
+		/* 发现当前区域active, 交换区状态为erasing，说明区域可能被擦除了也可能在擦除时被终止了，因此都需要先验证是否完全被擦除 */
+		/* 发现当前区域active, 交换区状态为obsolete，说明上次交换后旧的活动区还没有擦除 */
+		case REGION_COPY: 
+		case REGION_ACTIVE:
+		case REGION_ERASING:
+		case REGION_OBSOLETE:
+#if EE_USE_DATA_RING
+			/* 数据环模式只有索引区需要交换 */
+			if (verifyRegionFullyErased(pobj, pobj->indexSwapStartAddr))
+			{
+				eraseRegion(pobj, pobj->indexSwapStartAddr);
+			}
+#else
+			if (verifyRegionFullyErased(pobj, pobj->indexSwapStartAddr) || \
+			    verifyRegionFullyErased(pobj, pobj->dataSwapStartAddr))
+			{
+				/* 如果验证块没有被完全擦除则进行块的擦除 */
+				/* 如果在擦除时，单片机复位，区的状态还是处于erased */
+				eraseRegion(pobj, pobj->indexSwapStartAddr);
+				eraseRegion(pobj, pobj->dataSwapStartAddr);
+			}
+#endif
+
+			/* 将区的状态设置为verified */
+			regionStatus = REGION_VERIFIED;
+			flashWrite(pobj, pobj->indexSwapStartAddr - 4, (ee_uint8*)&regionStatus, 4);
+
+			/* 验证状态之间进行交换 */
+		case REGION_VERIFIED:
+			/* 交换索引区 */
+			swapData(pobj);
+			break;
+	}
+
+#if EE_USE_LOCK
+    seqWriteEnd(pobj);
+#endif
+#endif
+
+#if EE_USE_STATS
+    statsGcEnd(pobj);
+#endif
+}
+
+#if INCREMENTAL_SWAP
+/**
+ * @brief 推进增量垃圾回收
+ *
+ * @param budget 最多执行的工作量(force为1时不限制)
+ * @param force  1: 一直执行到切换完活动区为止(活动区已经写满时使用)
+ *
+ * @retval 0: 当前没有需要进行的回收工作 1: 回收工作还没有完成
+ */
+static ee_uint8 gcAdvance(ee_flash_t* pobj, ee_uint16 budget, ee_uint8 force)
+{
+    while ((pobj->gcState != GC_IDLE) || force || gcNeeded(pobj))
+    {
+        /* 交换区已经擦除，开始拷贝不计入工作量 */
+        if (pobj->gcState == GC_IDLE)
+        {
+            gcStartCopy(pobj);
+            continue;
+        }
+
+        if (!force)
+        {
+            if (budget == 0)
+                return 1;
+
+            budget--;
+        }
+
+        switch (pobj->gcState)
+        {
+            case GC_ERASE:
+                gcEraseStep(pobj);
+
+#if EE_USE_ASYNC_ERASE
+                /* 擦除期间不再占用CPU，下次调用再继续(强制回收时由下一次flash操作等待) */
+                if (pobj->eraseBusy && !force)
+                    return 1;
+#endif
+                break;
+
+            case GC_COPY:
+                gcCopyRecord(pobj, (variableLists)pobj->gcCopyId);
+
+                /* 交换区放不下时已经回到擦除阶段 */
+                if ((pobj->gcState == GC_COPY) && (++pobj->gcCopyId >= INSTANCE_DATA_NUM(pobj)))
+                    pobj->gcState = GC_MERGE;
+                break;
+
+            case GC_MERGE:
+                /* 切换完活动区后，强制回收就可以返回了 */
+                if (gcMergeStep(pobj) && force)
+                    return 0;
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief: 活动区的使用率是否达到了开始回收的阈值
+ */
+static ee_uint8 gcNeeded(ee_flash_t* pobj)
+{
+    ee_uint32 overwriteUsedSize = pobj->overwriteFreeAddr - pobj->overwriteAddr;
+    ee_uint32 overwriteAreaSize = pobj->indexStartAddr - 4 + SECTORS(pobj->indexRegionSize) - pobj->overwriteAddr;
+
+    /* 重写区为空时，活动区中的数据都是有效的，回收不出空间 */
+    if (overwriteUsedSize == 0)
+        return 0;
+
+    return ((pobj->dataFreeAddr * 100) >= (SECTORS(pobj->dataRegionSize) * EE_GC_THRESHOLD)) || \
+           ((overwriteUsedSize * 100) >= (overwriteAreaSize * EE_GC_THRESHOLD));
+}
+
+/**
+ * @brief: 检查交换区的一个扇区，没有完全擦除时将其擦除(先索引交换区，后数据交换区)
+ */
+static void gcEraseStep(ee_flash_t* pobj)
+{
+    ee_uint32 sectorAddr;
+
+    if (pobj->gcSector < pobj->indexRegionSize)
+        sectorAddr = pobj->indexSwapStartAddr - 4 + SECTORS(pobj->gcSector);
+    else
+        sectorAddr = pobj->dataSwapStartAddr + SECTORS(pobj->gcSector - pobj->indexRegionSize);
+
+    /* 擦除索引交换区第一个扇区后，区的状态就回到了erasing */
+    if (verifyRangeErased(pobj, sectorAddr, sectorAddr + SECTOR_SIZE))
+    {
+#if EE_USE_ASYNC_ERASE
+        flashEraseSectorAsync(pobj, sectorAddr);
+#else
+        flashEraseSector(pobj, sectorAddr);
+#endif
+    }
+
+    if (++pobj->gcSector >= (pobj->indexRegionSize + pobj->dataRegionSize))
+        pobj->gcState = GC_IDLE;
+}
+
+/**
+ * @brief: 交换区擦除完成后，开始向交换区拷贝数据
+ */
+static void gcStartCopy(ee_flash_t* pobj)
+{
+    ee_uint32 i;
+    ee_uint32 regionStatus = 0;
+
+    /* 与同步交换相同，先设置为verified再设置为copy，拷贝中断电时初始化会重新擦除交换区 */
+    regionStatus = REGION_VERIFIED;
+    flashWrite(pobj, pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+
+    regionStatus = REGION_COPY;
+    flashWrite(pobj, pobj->indexSwapStartAddr - 4, (ee_uint8 *)&regionStatus, 4);
+
+    pobj->gcCopyId = 0;
+    pobj->gcDataAddr = 0;
+    pobj->gcOverwriteFreeAddr = pobj->indexSwapStartAddr + SECTORS(pobj->indexAreaSize) + pobj->overwriteCountAreaSize;
+
+    for (i = 0; i < sizeof(pobj->gcDirty); i++)
+        pobj->gcDirty[i] = 0;
+
+    pobj->gcState = GC_COPY;
+}
+
+/**
+ * @brief: 将一个拷贝之后又被重写的数据追加到交换区的重写区，没有这样的数据时切换活动区
+ * @retval: 0: 拷贝阶段还没有完成 1: 已经切换活动区
+ */
+static ee_uint8 gcMergeStep(ee_flash_t* pobj)
+{
+    ee_uint32 i;
+    ee_uint32 swapOverwriteAddr = pobj->indexSwapStartAddr + SECTORS(pobj->indexAreaSize) + pobj->overwriteCountAreaSize;
+
+    for (i = 0; i < INSTANCE_DATA_NUM(pobj); i++)
+    {
+        if (pobj->gcDirty[i / 8] & (1 << (i % 8)))
+            break;
+    }
+
+    if (i >= INSTANCE_DATA_NUM(pobj))
+    {
+        ee_uint32 overwriteCount = (pobj->gcOverwriteFreeAddr - swapOverwriteAddr) / sizeof(ee_dataIndex);
+        ee_uint32 countAreaAddr = swapOverwriteAddr - pobj->overwriteCountAreaSize;
+
+        /* 一次写入交换区的重写计数 */
+        for (i = 0; i < overwriteCount; i += 32)
+        {
+            ee_uint32 addressValue = ((overwriteCount - i) >= 32) ? (ee_uint32)0x00000000 : ((ee_uint32)0xFFFFFFFF << (overwriteCount - i));
+
+            flashWrite(pobj, countAreaAddr + i / 8, (ee_uint8 *)&addressValue, sizeof(addressValue));
+        }
+
+#if EE_USE_LOCK
+        /* 只有切换活动区和重建RAM索引表期间读操作需要等待 */
+        seqWriteBegin(pobj);
+#endif
+
+        activateSwapRegion(pobj, pobj->gcDataAddr, pobj->gcOverwriteFreeAddr - swapOverwriteAddr);
+
+#if EE_USE_INDEX_TABLE
+        /* RAM索引表指向新的活动区 */
+        buildIndexTable(pobj);
+#endif
+
+#if EE_USE_LOCK
+        seqWriteEnd(pobj);
+#endif
+
+        /* 旧的活动区成为交换区，之后逐个扇区擦除 */
+        pobj->gcState = GC_ERASE;
+        pobj->gcSector = 0;
+
+        return 1;
+    }
+
+    pobj->gcDirty[i / 8] &= (ee_uint8)~(1 << (i % 8));
+
+    gcCopyRecord(pobj, (variableLists)i);
+
+    return 0;
+}
+
+/**
+ * @brief: 将一个数据在活动区中最新的索引和数据拷贝到交换区，交换区中已经有这个数据时追加到交换区的重写区
+ * @note:  交换区放不下时从擦除交换区开始重新回收，旧的活动区中数据仍然完整
+ */
+static void gcCopyRecord(ee_flash_t* pobj, variableLists dataId)
+{
+    ee_dataIndex readIndex;
+    ee_dataIndex swapIndex;
+    ee_uint32 readIndexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+    ee_uint32 swapIndexAddr = pobj->indexSwapStartAddr + sizeof(ee_dataIndex) * dataId;
+    ee_uint32 swapOverwriteAddr = pobj->indexSwapStartAddr + SECTORS(pobj->indexAreaSize) + pobj->overwriteCountAreaSize;
+
+    /* 超过索引区的数据不可能被写入 */
+    if (readIndexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
+        return;
+
+    flashRead(pobj, readIndexAddr, (ee_uint8 *)&readIndex, sizeof(readIndex));
+
+    if (readIndex.dataStatus == DATA_EMPTY)
+        return;
+
+    /* 获取活动区中最新的索引 */
+    if (readIndex.dataOverwriteAddr != INDEX_FIELD_EMPTY)
+        flashRead(pobj, getLastIndexAddrThatNotBeenOverwritten(pobj, dataId), (ee_uint8 *)&readIndex, sizeof(readIndex));
+    else if (readIndex.dataStatus != DATA_VALID)
+        return;
+
+    flashRead(pobj, swapIndexAddr, (ee_uint8 *)&swapIndex, sizeof(swapIndex));
+
+    if (((pobj->gcDataAddr + RECORD_SIZE(readIndex.dataSize)) > SECTORS(pobj->dataRegionSize)) || \
+        ((swapIndex.dataStatus != DATA_EMPTY) && \
+         ((pobj->gcOverwriteFreeAddr + sizeof(ee_dataIndex)) > (pobj->indexSwapStartAddr - 4 + SECTORS(pobj->indexRegionSize)))))
+    {
+        pobj->gcState = GC_ERASE;
+        pobj->gcSector = 0;
+        return;
+    }
+
+    /* 交换区在切换为活动区之前整体无效，这里不需要逐步写入数据状态 */
+    if (swapIndex.dataStatus == DATA_EMPTY)
+    {
+        transferDataAndIndex(pobj, &readIndex, &pobj->gcDataAddr, swapIndexAddr);
+        return;
+    }
+
+    /* 找到交换区中这个数据的最后一个索引 */
+    while (swapIndex.dataOverwriteAddr != INDEX_FIELD_EMPTY)
+    {
+        swapIndexAddr = swapOverwriteAddr + swapIndex.dataOverwriteAddr;
+        flashRead(pobj, swapIndexAddr, (ee_uint8 *)&swapIndex, sizeof(swapIndex));
+    }
+
+    transferDataAndIndex(pobj, &readIndex, &pobj->gcDataAddr, pobj->gcOverwriteFreeAddr);
+
+    swapIndex.dataOverwriteAddr = pobj->gcOverwriteFreeAddr - swapOverwriteAddr;
+    flashWrite(pobj, swapIndexAddr + sizeof(ee_dataIndex) - sizeof(swapIndex.dataOverwriteAddr), \
+               (ee_uint8 *)&swapIndex.dataOverwriteAddr,                                           \
+               sizeof(swapIndex.dataOverwriteAddr));
+
+    pobj->gcOverwriteFreeAddr += sizeof(ee_dataIndex);
+}
+
+/**
+ * @brief: 数据被重写后调用，已经拷贝到交换区的数据在切换活动区前需要重新拷贝
+ */
+static void gcMarkDirty(ee_flash_t* pobj, variableLists dataId)
+{
+    if (((pobj->gcState == GC_COPY) || (pobj->gcState == GC_MERGE)) && ((ee_uint32)dataId < pobj->gcCopyId))
+        pobj->gcDirty[dataId / 8] |= (ee_uint8)(1 << (dataId % 8));
+}
+#endif
+
+#if EE_USE_INDEX_TABLE
+/**
+ * @brief: 更新RAM索引表中的一项
+ */
+static void setIndexTable(ee_flash_t* pobj, variableLists dataId, ee_uint32 indexAddr, ee_size_t dataSize, ee_size_t dataAddr)
+{
+#if EE_USE_LOCK
+    seqWriteBegin(pobj);
+#endif
+
+    pobj->indexTable[dataId].indexAddr = indexAddr;
+    pobj->indexTable[dataId].dataSize = dataSize;
+    pobj->indexTable[dataId].dataAddr = dataAddr;
+
+#if EE_USE_LOCK
+    seqWriteEnd(pobj);
+#endif
+}
+
+/**
+ * @brief: 遍历索引区和重写链，建立RAM索引表(只在初始化和增量回收切换活动区时调用)
+ */
+static void buildIndexTable(ee_flash_t* pobj)
+{
+    ee_uint32 i;
+
+    for (i = 0; i < INSTANCE_DATA_NUM(pobj); i++)
+    {
+        ee_uint32 indexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * i;
+
+        pobj->indexTable[i].indexAddr = INDEX_TABLE_NONE;
+
+        /* 超过索引区的数据不可能被写入 */
+        if (indexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
+            continue;
+
+        resolveIndexTable(pobj, (variableLists)i, indexAddr);
+    }
+}
+
+/**
+ * @brief: 从indexAddr处的索引开始遍历重写链，最后一个没被重写的索引有效时写入RAM索引表
+ */
+static void resolveIndexTable(ee_flash_t* pobj, variableLists dataId, ee_uint32 indexAddr)
+{
+    ee_dataIndex dataIndex;
+
+    flashRead(pobj, indexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
+
+    if (dataIndex.dataStatus == DATA_EMPTY)
+        return;
+
+    /* 被重写过，最后一个没被重写的索引才是有效的 */
+    while (getNextIndexAddr(pobj, dataIndex.dataOverwriteAddr) != 0)
+    {
+        indexAddr = getNextIndexAddr(pobj, dataIndex.dataOverwriteAddr);
+
+        flashRead(pobj, indexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
+    }
+
+    /* 没有被重写，同时数据无效 */
+    if (dataIndex.dataStatus != DATA_VALID)
+        return;
+
+    setIndexTable(pobj, dataId, indexAddr, dataIndex.dataSize, dataIndex.dataAddr);
+}
+#endif
+
+#if EE_USE_CHECKPOINT
+/**
+ * @brief: 距离上一个检查点，重写区新增的索引达到EE_CHECKPOINT_INTERVAL个时，在重写区写入一个新的检查点
+ */
+static void writeCheckpoint(ee_flash_t* pobj)
+{
+    ee_uint32 i, j, num;
+    ee_dataIndex header;
+    ee_uint32 bodyAddr = pobj->overwriteFreeAddr;
+    ee_uint32 headerAddr = bodyAddr + sizeof(ee_dataIndex) * CHECKPOINT_BODY_NUM(pobj);
+
+    if ((pobj->overwriteFreeAddr - pobj->checkpointAddr) < sizeof(ee_dataIndex) * EE_CHECKPOINT_INTERVAL)
+        return;
+
+    /* 重写区放不下检查点时不再写入，重写区写满交换后重写链会重新开始 */
+    if ((headerAddr + sizeof(ee_dataIndex)) > (pobj->indexStartAddr - 4 + SECTORS(pobj->indexRegionSize)))
+        return;
+
+    /* 整个检查点只计数一次 */
+    countAreaAdd(pobj, CHECKPOINT_BODY_NUM(pobj) + 1);
+    pobj->overwriteFreeAddr = headerAddr + sizeof(ee_dataIndex);
+
+    /* 每条记录保存3个数据最新索引相对于indexStartAddr的偏移地址，没有有效索引的为全1 */
+    for (i = 0; i < CHECKPOINT_BODY_NUM(pobj); i += num)
+    {
+        ee_size_t *pfield = (ee_size_t *)INSTANCE_COPY_BUF(pobj);
+
+        num = CHECKPOINT_BODY_NUM(pobj) - i;
+        if (num > sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex))
+            num = sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex);
+
+        for (j = 0; j < num * 4; j++)
+        {
+            ee_uint32 dataId = (i + j / 4) * 3 + j % 4 - 1;
+
+            if (j % 4 == 0)
+                pfield[j] = DATA_CHECKPOINT_BODY;
+            else if ((dataId < INSTANCE_DATA_NUM(pobj)) && (pobj->indexTable[dataId].indexAddr != INDEX_TABLE_NONE))
+                pfield[j] = (ee_size_t)(pobj->indexTable[dataId].indexAddr - pobj->indexStartAddr);
+            else
+                pfield[j] = INDEX_FIELD_EMPTY;
+        }
+
+        flashWriteCombine(pobj, bodyAddr + sizeof(ee_dataIndex) * i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), sizeof(ee_dataIndex) * num);
+    }
+
+    /* 头记录在所有记录写入之后一次写入，写入中途断电时状态或大小不对，初始化时不会使用这个检查点 */
+    header.dataStatus = DATA_CHECKPOINT;
+    header.dataSize = CHECKPOINT_BODY_NUM(pobj);
+    header.dataAddr = pobj->dataFreeAddr;
+    header.dataOverwriteAddr = INDEX_FIELD_EMPTY;
+    flashWrite(pobj, headerAddr, (ee_uint8 *)&header, sizeof(header));
+
+    pobj->checkpointAddr = pobj->overwriteFreeAddr;
+}
+
+/**
+ * @brief: 找到重写区中最后一个检查点，从检查点记录的索引位置继续遍历重写链，建立RAM索引表(只在初始化时调用)
+ *
+ * @retval 0: 没有可用的检查点 1: RAM索引表已经建立
+ */
+static ee_uint8 loadCheckpoint(ee_flash_t* pobj)
+{
+    ee_uint32 i, j, num;
+    ee_uint32 headerAddr, bodyAddr;
+    ee_dataIndex header;
+
+    pobj->checkpointAddr = pobj->overwriteAddr;
+
+    /* 从重写区写入游标向前成块读出索引，找到最后一个头记录 */
+    for (i = (pobj->overwriteFreeAddr - pobj->overwriteAddr) / sizeof(ee_dataIndex); i > 0; i -= num)
+    {
+        num = i;
+        if (num > sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex))
+            num = sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex);
+
+        flashRead(pobj, pobj->overwriteAddr + sizeof(ee_dataIndex) * (i - num), (ee_uint8 *)INSTANCE_COPY_BUF(pobj), sizeof(ee_dataIndex) * num);
+
+        for (j = num; j > 0; j--)
+        {
+            if (((ee_dataIndex *)INSTANCE_COPY_BUF(pobj))[j - 1].dataStatus == DATA_CHECKPOINT)
+                break;
+        }
+
+        if (j > 0)
+        {
+            header = ((ee_dataIndex *)INSTANCE_COPY_BUF(pobj))[j - 1];
+            break;
+        }
+    }
+
+    if (i == 0)
+        return 0;
+
+    headerAddr = pobj->overwriteAddr + sizeof(ee_dataIndex) * (i - num + j - 1);
+
+    /* 头记录没有完整写入，或者前面放不下检查点记录(不是检查点) */
+    if ((header.dataSize != CHECKPOINT_BODY_NUM(pobj)) || (header.dataOverwriteAddr != INDEX_FIELD_EMPTY) || \
+        (headerAddr < pobj->overwriteAddr + sizeof(ee_dataIndex) * CHECKPOINT_BODY_NUM(pobj)))
+        return 0;
+
+    bodyAddr = headerAddr - sizeof(ee_dataIndex) * CHECKPOINT_BODY_NUM(pobj);
+
+    for (i = 0; i < CHECKPOINT_BODY_NUM(pobj); i += num)
+    {
+        ee_size_t *pfield = (ee_size_t *)INSTANCE_COPY_BUF(pobj);
+
+        num = CHECKPOINT_BODY_NUM(pobj) - i;
+        if (num > sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex))
+            num = sizeof(INSTANCE_COPY_BUF(pobj)) / sizeof(ee_dataIndex);
+
+        flashRead(pobj, bodyAddr + sizeof(ee_dataIndex) * i, (ee_uint8 *)INSTANCE_COPY_BUF(pobj), sizeof(ee_dataIndex) * num);
+
+        for (j = 0; j < num * 4; j++)
+        {
+            ee_uint32 dataId = (i + j / 4) * 3 + j % 4 - 1;
+            ee_uint32 indexAddr;
+
+            if (j % 4 == 0)
+            {
+                /* 记录不完整时RAM索引表由buildIndexTable()重新建立 */
+                if (pfield[j] != DATA_CHECKPOINT_BODY)
+                    return 0;
+
+                continue;
+            }
+
+            if (dataId >= INSTANCE_DATA_NUM(pobj))
+                continue;
+
+            pobj->indexTable[dataId].indexAddr = INDEX_TABLE_NONE;
+            indexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * dataId;
+
+            /* 检查点之前没有有效索引的数据，之后可能在索引区第一次写入 */
+            if (pfield[j] != INDEX_FIELD_EMPTY)
+                indexAddr = pobj->indexStartAddr + pfield[j];
+            else if (indexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
+                continue;
+
+            resolveIndexTable(pobj, (variableLists)dataId, indexAddr);
+        }
+    }
+
+    pobj->checkpointAddr = headerAddr + sizeof(ee_dataIndex);
+
+    return 1;
+}
+#endif
+
+#if EE_USE_DATA_RING
+/**
+ * @brief: 挂载时恢复数据环的头尾扇区和写入游标(需要RAM索引表已经建立)
+ */
+static void ringRecover(ee_flash_t* pobj)
+{
+    ee_uint16 i;
+    ee_uint8 found = 0;
+    ee_uint32 header[2];
+    ee_uint32 tailSeq = 0;
+#if EE_USE_HOT_COLD
+    ee_uint32 coldSeq = 0;
+
+    pobj->dataFreeSectorNum = 0;
+    pobj->dataColdSector = 0xFFFF;
+    pobj->dataColdFreeAddr = (ee_uint32)0xFFFFFFFF;
+    pobj->dataColdWriting = 0;
+#endif
+
+    /* 扇区头部序号和序号取反匹配才是正在使用的扇区，序号最大的是头，最小的是尾 */
+    for (i = 0; i < pobj->dataRegionSize; i++)
+    {
+        flashRead(pobj, pobj->dataStartAddr + SECTORS(i), (ee_uint8 *)header, sizeof(header));
+
+        if (header[0] != ~header[1])
+        {
+#if EE_USE_HOT_COLD
+            pobj->dataFreeSectorNum++;
+#endif
+            continue;
+        }
+
+#if EE_USE_HOT_COLD
+        /* 序号为奇数的是冷数据扇区，序号最大的那个是冷数据的写入位置 */
+        if (header[0] & 1)
+        {
+            if ((pobj->dataColdSector == 0xFFFF) || ((ee_int32)(header[0] - coldSeq) > 0))
+            {
+                coldSeq = header[0];
+                pobj->dataColdSector = i;
+            }
+            continue;
+        }
+#endif
+
+        if (!found || ((ee_int32)(header[0] - pobj->dataHeadSeq) > 0))
+        {
+            pobj->dataHeadSeq = header[0];
+            pobj->dataHeadSector = i;
+        }
+
+        if (!found || ((ee_int32)(header[0] - tailSeq) < 0))
+        {
+            tailSeq = header[0];
+            pobj->dataTailSector = i;
+        }
+
+        found = 1;
+    }
+
+#if EE_USE_HOT_COLD
+    if (pobj->dataColdSector != 0xFFFF)
+    {
+        /* 只剩下冷数据扇区时把它当作头扇区继续使用 */
+        if (!found)
+        {
+            pobj->dataHeadSeq = coldSeq;
+            pobj->dataHeadSector = pobj->dataColdSector;
+            pobj->dataColdSector = 0xFFFF;
+            found = 1;
+        }
+        else
+        {
+            /* 新打开的扇区序号要比所有扇区都大 */
+            if ((ee_int32)(coldSeq - pobj->dataHeadSeq) > 0)
+                pobj->dataHeadSeq = coldSeq;
+
+            pobj->dataColdFreeAddr = ringRecoverFreeAddr(pobj, pobj->dataColdSector);
+        }
+    }
+#endif
+
+    /* 全新的数据环，从0号扇区开始使用 */
+    if (!found)
+    {
+        pobj->dataHeadSeq = (ee_uint32)0xFFFFFFFF;
+        pobj->dataTailSector = 0;
+        ringOpenSector(pobj, 0);
+        return;
+    }
+
+    pobj->dataFreeAddr = ringRecoverFreeAddr(pobj, pobj->dataHeadSector);
+}
+
+/**
+ * @brief 恢复数据环中一个扇区的写入游标
+ * @param pobj 模拟eeprom对象
+ * @param sector 扇区号
+ * @return 扇区中最后一个有效数据的结尾
+ */
+static ee_uint32 ringRecoverFreeAddr(ee_flash_t* pobj, ee_uint16 sector)
+{
+    ee_uint16 i;
+    ee_uint32 freeAddr, sectorEndAddr;
+
+    /* 扇区中最后一个有效数据的结尾就是写入游标 */
+    freeAddr = SECTORS(sector) + RING_SECTOR_HEADER_SIZE;
+    sectorEndAddr = SECTORS(sector + 1);
+
+    for (i = 0; i <= INSTANCE_DATA_NUM(pobj); i++)
+    {
+        ee_dataIndex dataIndex;
+        ee_uint32 indexAddr;
+
+        if ((i < INSTANCE_DATA_NUM(pobj)) && (pobj->indexTable[i].indexAddr != INDEX_TABLE_NONE))
+        {
+            dataIndex.dataStatus = DATA_VALID;
+            dataIndex.dataSize = pobj->indexTable[i].dataSize;
+            dataIndex.dataAddr = pobj->indexTable[i].dataAddr;
+        }
+        else
+        {
+            /* 写入时断电的数据没有有效索引(第一次写入在索引区，重写在重写区最后一个索引)，也要跳过它占用的空间 */
+            if (i < INSTANCE_DATA_NUM(pobj))
+            {
+                indexAddr = pobj->indexStartAddr + sizeof(ee_dataIndex) * i;
+
+                /* 超过索引区的数据不可能被写入 */
+                if (indexAddr >= (pobj->overwriteAddr - pobj->overwriteCountAreaSize))
+                    continue;
+            }
+            else if (pobj->overwriteFreeAddr != pobj->overwriteAddr)
+            {
+                indexAddr = pobj->overwriteFreeAddr - sizeof(ee_dataIndex);
+            }
+            else
+            {
+                break;
+            }
+
+            flashRead(pobj, indexAddr, (ee_uint8 *)&dataIndex, sizeof(dataIndex));
+
+            /* 状态为invalid时大小和地址可能还没有写入，重写区最后一个索引即使有效也可能还没有被链接
+             * 最后一个是检查点时，它之前的数据都已经在RAM索引表中 */
+            if ((dataIndex.dataStatus == DATA_EMPTY) || (dataIndex.dataSize == INDEX_FIELD_EMPTY) || \
+                ((dataIndex.dataStatus == DATA_VALID) && (i < INSTANCE_DATA_NUM(pobj))) || (dataIndex.dataStatus == DATA_CHECKPOINT))
+                continue;
+        }
+
+        if ((dataIndex.dataAddr >= SECTORS(sector)) && \
+            (dataIndex.dataAddr < sectorEndAddr) &&                   \
+            (freeAddr < getIndexDataEnd(&dataIndex)))
+        {
+            freeAddr = getIndexDataEnd(&dataIndex);
+        }
+    }
+
+    /* 仍然有没有索引的数据时，这部分空间直接放弃 */
+    if (verifyRangeErased(pobj, pobj->dataStartAddr + freeAddr, pobj->dataStartAddr + sectorEndAddr))
+        freeAddr = sectorEndAddr;
+
+    return freeAddr;
+}
+
+/**
+ * @brief: 将一个空闲扇区作为数据环新的头扇区
+ */
+static void ringOpenSector(ee_flash_t* pobj, ee_uint16 sector)
+{
+    ee_uint32 header[2];
+    ee_uint32 sectorAddr = pobj->dataStartAddr + SECTORS(sector);
+
+    /* 空闲扇区可能在擦除时被中断过，使用前确认已经完全擦除 */
+    if (verifyRangeErased(pobj, sectorAddr, sectorAddr + SECTOR_SIZE))
+        flashEraseSector(pobj, sectorAddr);
+
+#if EE_USE_HOT_COLD
+    pobj->dataFreeSectorNum--;
+#endif
+
+    pobj->dataHeadSeq++;
+#if EE_USE_HOT_COLD
+    /* 冷数据扇区的序号用奇数，热数据扇区用偶数，挂载时可以分别恢复两个写入位置 */
+    if ((pobj->dataHeadSeq & 1) != pobj->dataColdWriting)
+        pobj->dataHeadSeq++;
+#endif
+    header[0] = pobj->dataHeadSeq;
+    header[1] = ~pobj->dataHeadSeq;
+    flashWrite(pobj, sectorAddr, (ee_uint8 *)header, sizeof(header));
+
+    pobj->dataHeadSector = sector;
+    pobj->dataFreeAddr = SECTORS(sector) + RING_SECTOR_HEADER_SIZE;
+}
+
+/**
+ * @brief: 数据环中空闲扇区的个数
+ */
+static ee_uint16 ringFreeSectors(ee_flash_t* pobj)
+{
+#if EE_USE_HOT_COLD
+    /* 回收的扇区不一定是最旧的扇区，正在使用的扇区不再连续 */
+    return pobj->dataFreeSectorNum;
+#else
+    ee_uint16 usedSectors = (pobj->dataHeadSector + pobj->dataRegionSize - pobj->dataTailSector) % pobj->dataRegionSize + 1;
+
+    return pobj->dataRegionSize - usedSectors;
+#endif
+}
+
+/**
+ * @brief: 下一个作为头扇区的空闲扇区(调用前需要保证有空闲扇区)
+ */
+static ee_uint16 ringNextFreeSector(ee_flash_t* pobj)
+{
+#if EE_USE_HOT_COLD
+    ee_uint16 i, sector;
+    ee_uint32 header[2];
+
+    /* 扇区头部无效的就是空闲扇区 */
+    for (i = 1; i <= pobj->dataRegionSize; i++)
+    {
+        sector = (ee_uint16)((pobj->dataHeadSector + i) % pobj->dataRegionSize);
+
+        flashRead(pobj, pobj->dataStartAddr + SECTORS(sector), (ee_uint8 *)header, sizeof(header));
+        if (header[0] != ~header[1])
+            return sector;
+    }
+#endif
+
+    return (pobj->dataHeadSector + 1) % pobj->dataRegionSize;
+}
+
+/**
+ * @brief 在数据环中为size字节的数据分配空间，分配到的地址就是数据区写入游标(数据不会跨扇区存放)
+ *
+ * @param size 数据大小
+ * @param isGc 1: 回收扇区时搬移数据，可以使用保留的空闲扇区
+ *
+ * @retval 0: 分配成功 1: 空间不足
+ */
+static ee_uint8 ringAlloc(ee_flash_t* pobj, ee_size_t size, ee_uint8 isGc)
+{
+    ee_uint16 reclaimCount = 0;
+    ee_uint32 sectorEndAddr;
+
+    if (size > SECTOR_SIZE - RING_SECTOR_HEADER_SIZE)
+        return 1;
+
+    for (;;)
+    {
+        sectorEndAddr = SECTORS(pobj->dataHeadSector + 1);
+
+        /* 上次回收时断电，保留的空闲扇区已经被用掉，先完成回收再写入 */
+        if (!isGc && (ringFreeSectors(pobj) < RING_RESERVED_SECTORS))
+        {
+            if ((reclaimCount++ >= pobj->dataRegionSize) || ringReclaimSector(pobj))
+                return 1;
+
+            continue;
+        }
+
+        /* 头扇区剩余空间足够 */
+        if ((pobj->dataFreeAddr < sectorEndAddr) && (pobj->dataFreeAddr + size <= sectorEndAddr))
+            return 0;
+
+        /* 普通写入总是给回收扇区保留空闲扇区 */
+        if (ringFreeSectors(pobj) >= (isGc ? 1 : (RING_RESERVED_SECTORS + 1)))
+        {
+            ringOpenSector(pobj, ringNextFreeSector(pobj));
+        }
+        else if (isGc || (reclaimCount++ >= pobj->dataRegionSize) || ringReclaimSector(pobj))
+        {
+            /* 所有扇区都是有效数据，回收不出空间 */
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief: 回收数据环中最旧的扇区(开启EE_USE_HOT_COLD时回收有效数据最少的扇区)，只把其中仍然有效的数据搬到头扇区，然后擦除这一个扇区
+ * @retval: 0: 回收成功 1: 回收失败
+ */
+static ee_uint8 ringReclaimSector(ee_flash_t* pobj)
+{
+    ee_uint8 ret;
+#if EE_USE_HOT_COLD
+    ee_uint32 liveSize;
+    ee_uint16 sector = ringPickVictim(pobj, &liveSize);
+
+    /* 除了正在写入的扇区都是空闲的 */
+    if (sector == 0xFFFF)
+        return 1;
+
+#if EE_USE_STATS
+    statsGcBegin(pobj);
+#endif
+
+    if (sector == pobj->dataColdSector)
+    {
+        /* 只剩冷数据扇区可以回收时把其中的数据搬回头扇区，冷数据不再单独占用扇区 */
+        pobj->dataColdSector = 0xFFFF;
+        pobj->dataColdFreeAddr = (ee_uint32)0xFFFFFFFF;
+        ret = ringMoveSector(pobj, SECTORS(sector));
+    }
+    else
+    {
+        /* 能留到回收时的数据都是很久没有重写的冷数据，写入冷数据扇区，不和新写入的数据混在一起 */
+        ringSwapFrontier(pobj);
+        ret = ringMoveSector(pobj, SECTORS(sector));
+        ringSwapFrontier(pobj);
+    }
+#else
+    ee_uint16 sector = pobj->dataTailSector;
+
+    /* 正在写入的扇区不能回收 */
+    if (sector == pobj->dataHeadSector)
+        return 1;
+
+#if EE_USE_STATS
+    statsGcBegin(pobj);
+#endif
+
+    ret = ringMoveSector(pobj, SECTORS(sector));
+#endif
+
+    if (ret)
+    {
+#if EE_USE_STATS
+        statsGcEnd(pobj);
+#endif
+        return 1;
+    }
+
+#if EE_USE_ASYNC_ERASE
+    /* 回收的扇区在下一次使用前会先检查是否已经擦除，可以异步擦除 */
+    flashEraseSectorAsync(pobj, pobj->dataStartAddr + SECTORS(sector));
+#else
+    flashEraseSector(pobj, pobj->dataStartAddr + SECTORS(sector));
+#endif
+
+#if EE_USE_HOT_COLD
+    pobj->dataFreeSectorNum++;
+#else
+    pobj->dataTailSector = (pobj->dataTailSector + 1) % pobj->dataRegionSize;
+#endif
+
+#if EE_USE_STATS
+    pobj->stats.gcCount++;
+    statsGcEnd(pobj);
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief: 把一个扇区中仍然有效的数据搬到头扇区
+ * @retval: 0: 搬移完成 1: 空间不足
+ */
+static ee_uint8 ringMoveSector(ee_flash_t* pobj, ee_uint32 sectorStartAddr)
+{
+    ee_uint32 i;
+    ee_dataIndex currentdataIndex;
+
+    for (i = 0; i < INSTANCE_DATA_NUM(pobj); i++)
+    {
+        ee_indexTable_t *pitem = &pobj->indexTable[i];
+
+        if ((pitem->indexAddr == INDEX_TABLE_NONE) || (pitem->dataAddr < sectorStartAddr) || (pitem->dataAddr >= sectorStartAddr + SECTOR_SIZE))
+            continue;
+
+        if (ringAlloc(pobj, RECORD_SIZE(pitem->dataSize), 1))
+            return 1;
+
+        if (isOverwriteAreaFull(pobj))
+            swapRegion(pobj);
+
+        /* 有效数据按普通重写的流程搬到头扇区，断电时旧数据仍然有效 */
+        flashRead(pobj, pobj->indexStartAddr + sizeof(ee_dataIndex) * i, (ee_uint8 *)&currentdataIndex, sizeof(currentdataIndex));
+        writeRecord(pobj, (variableLists)i, &currentdataIndex, 0, pobj->dataStartAddr + pitem->dataAddr, pitem->dataSize);
+    }
+
+    return 0;
+}
+
+#if EE_USE_INCREMENTAL_GC || EE_USE_HOT_COLD
+/**
+ * @brief: 数据环中一个扇区里有效数据的总大小
+ */
+static ee_uint32 ringLiveSize(ee_flash_t* pobj, ee_uint16 sector)
+{
+    ee_uint32 i;
+    ee_uint32 liveSize = 0;
+    ee_uint32 sectorStartAddr = SECTORS(sector);
+
+    for (i = 0; i < INSTANCE_DATA_NUM(pobj); i++)
+    {
+        ee_indexTable_t *pitem = &pobj->indexTable[i];
+
+        if ((pitem->indexAddr != INDEX_TABLE_NONE) && (pitem->dataAddr >= sectorStartAddr) && (pitem->dataAddr < sectorStartAddr + SECTOR_SIZE))
+            liveSize += RECORD_SIZE(pitem->dataSize);
+    }
+
+    return liveSize;
+}
+#endif
+
+#if EE_USE_HOT_COLD
+/**
+ * @brief: 选出有效数据最少的扇区作为回收的扇区(正在写入的头扇区和冷数据扇区除外)
+ * @retval: 扇区号，没有可以回收的扇区时返回0xFFFF
+ */
+static ee_uint16 ringPickVictim(ee_flash_t* pobj, ee_uint32* pliveSize)
+{
+    ee_uint16 i;
+    ee_uint16 victim = 0xFFFF;
+    ee_uint32 liveSize;
+    ee_uint32 header[2];
+
+    /* 没有可以回收的扇区时有效数据大小为0 */
+    *pliveSize = 0;
+
+    for (i = 0; i < pobj->dataRegionSize; i++)
+    {
+        if ((i == pobj->dataHeadSector) || (i == pobj->dataColdSector))
+            continue;
+
+        liveSize = ringLiveSize(pobj, i);
+        if ((victim != 0xFFFF) && (liveSize >= *pliveSize))
+            continue;
+
+        /* 空闲扇区不需要回收 */
+        flashRead(pobj, pobj->dataStartAddr + SECTORS(i), (ee_uint8 *)header, sizeof(header));
+        if (header[0] != ~header[1])
+            continue;
+
+        victim = i;
+        *pliveSize = liveSize;
+    }
+
+    /* 冷数据扇区还在写入，只在没有别的扇区可以回收时才选它 */
+    if ((victim == 0xFFFF) && (pobj->dataColdSector != 0xFFFF))
+    {
+        victim = pobj->dataColdSector;
+        *pliveSize = ringLiveSize(pobj, victim);
+    }
+
+    return victim;
+}
+
+/**
+ * @brief: 交换头扇区和冷数据扇区的写入位置，交换后写入和打开新扇区都在冷数据扇区进行
+ */
+static void ringSwapFrontier(ee_flash_t* pobj)
+{
+    ee_uint16 sector = pobj->dataHeadSector;
+    ee_uint32 freeAddr = pobj->dataFreeAddr;
+
+    pobj->dataHeadSector = pobj->dataColdSector;
+    pobj->dataFreeAddr = pobj->dataColdFreeAddr;
+    pobj->dataColdSector = sector;
+    pobj->dataColdFreeAddr = freeAddr;
+    pobj->dataColdWriting = !pobj->dataColdWriting;
+}
+#endif
+
+#if EE_USE_INCREMENTAL_GC
+/**
+ * @brief: 数据环的使用率是否达到了开始回收的阈值，并且要回收的扇区值得回收
+ */
+static ee_uint8 ringNeedGc(ee_flash_t* pobj)
+{
+    ee_uint32 liveSize;
+    ee_uint32 usedSectors = pobj->dataRegionSize - ringFreeSectors(pobj);
+
+    if ((usedSectors * 100) < ((ee_uint32)pobj->dataRegionSize * EE_GC_THRESHOLD))
+        return 0;
+
+#if EE_USE_HOT_COLD
+    if (ringPickVictim(pobj, &liveSize) == 0xFFFF)
+        return 0;
+#else
+    if (pobj->dataTailSector == pobj->dataHeadSector)
+        return 0;
+
+    liveSize = ringLiveSize(pobj, pobj->dataTailSector);
+#endif
+
+    /* 要回收的扇区中有效数据超过一半时，回收腾出的空间太少，留给写入时再回收 */
+    return (liveSize * 2) <= (SECTOR_SIZE - RING_SECTOR_HEADER_SIZE);
 }
+#endif
+#endif
@@ -16,6 +16,12 @@
 #ifndef __FLASH_EMULATEEEPROM_H_
 #define __FLASH_EMULATEEEPROM_H_
 
+/* 可以通过编译选项 -DEE_CONFIG_FILE=\"xxx.h\" 指定配置文件，在配置文件中定义下面带#ifndef保护的宏，
+ * 这样不用修改本文件就可以换用其他flash驱动(例如在PC上使用模拟flash测试) */
+#ifdef EE_CONFIG_FILE
+#include EE_CONFIG_FILE
+#endif
+
 /* 用户根据自己单片机位数修改 */
 typedef char           ee_int8;
 typedef short          ee_int16;
@@ -25,9 +31,30 @@ typedef unsigned short ee_uint16;
 typedef unsigned int   ee_uint32;
 
 /* 当前flash一个扇区的大小(单位:byte) */
+#ifndef SECTOR_SIZE
 #define SECTOR_SIZE 
+#endif
 /* 当前flash一个块有多少个扇区 */
+#ifndef BLOCk_SECTOR_NUM
 #define BLOCk_SECTOR_NUM 
+#endif
+/* 当前flash一页的大小(单位:byte)，一次写操作不会跨页，片内flash可以填写扇区大小 */
+#ifndef FLASH_PAGE_SIZE
+#define FLASH_PAGE_SIZE 256
+#endif
+
+/* 索引结构中数据大小和地址是否使用32位(1:开启 0:关闭)
+ * 关闭时每个索引8字节，单个数据和每个区域最大64KB；开启后每个索引16字节，单个数据和每个区域最大4GB */
+#ifndef EE_USE_WIDE_INDEX
+#define EE_USE_WIDE_INDEX 0
+#endif
+
+/* 数据大小和数据区偏移地址的类型 */
+#if EE_USE_WIDE_INDEX
+typedef ee_uint32 ee_size_t;
+#else
+typedef ee_uint16 ee_size_t;
+#endif
 
 /* 返回第x扇区的地址 */
 #define SECTORS(x) (ee_uint32)((x) * SECTOR_SIZE)
@@ -35,11 +62,364 @@ typedef unsigned int   ee_uint32;
 #define BLOCKS(x)  (ee_uint32)((x) * BLOCk_SECTOR_NUM * SECTOR_SIZE)
 
 /* 函数类型 void (*) (uint32 flashAddr, uint8* dataAddr, uint16 num) */
+#ifndef ee_flashWrite
 #define ee_flashWrite
+#endif
+#ifndef ee_flashRead
 #define ee_flashRead
+#endif
 
 /* 函数原型 void (*) (uint32 flashAddr) */
+#ifndef ee_flashEraseASector
 #define ee_flashEraseASector
+#endif
+
+/* 可选：块擦除驱动函数名，函数原型 void (*) (uint32 flashAddr)，需要填写BLOCk_SECTOR_NUM
+ * 填写后擦除区域时按块对齐的部分整块擦除，其余部分仍然按扇区擦除 */
+/* #define ee_flashEraseABlock */
+
+/* 可选：查空驱动函数名(例如片内flash的硬件查空)，函数原型 uint8 (*) (uint32 flashAddr, uint32 num)
+ * 返回0表示[flashAddr, flashAddr + num)全部为0xFF，不填写时成块读出比较 */
+/* #define ee_flashBlankCheck */
+
+/* 是否支持多个互相独立的存储实例(1:开启 0:关闭)，例如片内flash和spi flash上各放一个
+ * 开启后每个ee_flash_t使用自己的驱动函数和数据个数，需要在ee_flashInit之前调用ee_setInstance()设置，不再使用上面的驱动函数名
+ * 各实例的区域交换和回收只访问自己的区域，搬运、压缩和批量写入使用的缓冲区也属于各自的ee_flash_t，扇区大小等其余配置所有实例共用
+ * NOTE: 不开启EE_USE_LOCK时不同实例可以在不同任务中同时使用，同一个实例仍然只能在一个任务中使用；
+ *       开启EE_USE_LOCK时所有实例共用ee_writeLock/ee_writeUnlock这一把写锁，不同实例的写操作也会互相等待 */
+#ifndef EE_USE_MULTI_INSTANCE
+#define EE_USE_MULTI_INSTANCE 0
+#endif
+
+/* 是否在RAM中为每个数据保存一份最新索引(1:开启 0:关闭)
+ * 开启后读数据不需要再遍历重写链，每个数据额外占用8字节RAM */
+#ifndef EE_USE_INDEX_TABLE
+#define EE_USE_INDEX_TABLE 0
+#endif
+
+/* 是否把数据区作为由多个扇区组成的环使用(1:开启 0:关闭)，需要开启EE_USE_INDEX_TABLE
+ * 开启后数据区没有交换区，空间不足时只回收最旧的一个扇区(只搬移其中仍然有效的数据)，擦除次数均匀分布到所有扇区
+ * 数据区至少需要4个扇区，每个数据的大小不能超过(SECTOR_SIZE - 8) */
+#ifndef EE_USE_DATA_RING
+#define EE_USE_DATA_RING 0
+#endif
+
+/* 数据环回收扇区时是否区分冷热数据(1:开启 0:关闭)，需要开启EE_USE_DATA_RING
+ * 开启后回收有效数据最少的扇区(不再按顺序回收最旧的扇区)，回收时搬移的数据(上一次写入后一直没有重写的冷数据)
+ * 写入单独的冷数据扇区，冷数据扇区很少被选中回收，经常重写的数据不会再带着冷数据一起反复搬移 */
+#ifndef EE_USE_HOT_COLD
+#define EE_USE_HOT_COLD 0
+#endif
+
+/* 是否使用增量垃圾回收(1:开启 0:关闭)
+ * 开启后区域交换由ee_gcStep()分步完成，写入时只有在活动区已经写满时才会同步完成剩余的交换工作 */
+#ifndef EE_USE_INCREMENTAL_GC
+#define EE_USE_INCREMENTAL_GC 0
+#endif
+
+/* 是否在ee_gcStep()中异步擦除扇区(1:开启 0:关闭)，需要开启EE_USE_INCREMENTAL_GC并填写下面两个驱动函数名
+ * 开启后ee_gcStep()启动擦除后立即返回，擦除期间CPU可以做其他事情，之后的flash操作会先等待擦除完成
+ * 只有ee_gcStep()和ee_poll()中的擦除是异步的：ee_writeDataToFlash()和读取、写入时同步完成的交换和回收、ee_flashInit()都是同步的 */
+#ifndef EE_USE_ASYNC_ERASE
+#define EE_USE_ASYNC_ERASE 0
+#endif
+
+/* 是否提供不等待擦除的写入接口ee_writeStart()和ee_poll()(1:开启 0:关闭)，需要开启EE_USE_ASYNC_ERASE，不支持EE_USE_DATA_RING
+ * 开启后ee_writeStart()只登记写入，之后由ee_poll()推进：活动区放不下时每次调用推进一步增量回收(与ee_gcStep()相同)，
+ * 擦除还在进行时立即返回，空间足够后在一次调用中写入这个数据。ee_poll()不会等待擦除，写入一个数据的几次写操作仍然是同步的 */
+#ifndef EE_USE_ASYNC_WRITE
+#define EE_USE_ASYNC_WRITE 0
+#endif
+
+/* 启动一个扇区的擦除后立即返回，函数原型 void (*) (uint32 flashAddr) */
+#ifndef ee_flashEraseASectorStart
+#define ee_flashEraseASectorStart
+#endif
+/* 擦除还没有完成时返回非0，函数原型 uint8 (*) (void) */
+#ifndef ee_flashIsBusy
+#define ee_flashIsBusy
+#endif
+
+/* 是否把存储区按页交替分布到两片flash上(1:开启 0:关闭)，适合两片spi flash在不同总线上的情况
+ * 开启后ee_flashInit使用的是两片flash合起来的地址：相邻两页分别在两片flash上，同一次写入中的多页和一个扇区的擦除在两片flash上同时进行
+ * SECTOR_SIZE填写单片flash扇区大小的2倍，需要填写下面四个驱动函数名，不再使用上面的驱动函数名 */
+#ifndef EE_USE_STRIPE
+#define EE_USE_STRIPE 0
+#endif
+
+/* 开启EE_USE_STRIPE时必须填写下面四个驱动函数名，没有填写时编译报错 */
+/* 启动一片flash的写入(不跨页)后立即返回，写完之前不能修改buf，函数原型 void (*) (uint8 dev, uint32 flashAddr, uint8* buf, uint16 num)，dev为0或1 */
+/* #define ee_stripeWriteStart */
+/* 读一片flash，函数原型 void (*) (uint8 dev, uint32 flashAddr, uint8* buf, uint16 num) */
+/* #define ee_stripeRead */
+/* 启动一片flash一个扇区的擦除后立即返回，函数原型 void (*) (uint8 dev, uint32 flashAddr) */
+/* #define ee_stripeEraseStart */
+/* 一片flash的写入或擦除还没有完成时返回非0，函数原型 uint8 (*) (uint8 dev) */
+/* #define ee_stripeIsBusy */
+
+/* 增量垃圾回收的启动阈值(单位:%)，数据区或重写区的使用率达到阈值时ee_gcStep()开始回收 */
+#ifndef EE_GC_THRESHOLD
+#define EE_GC_THRESHOLD 75
+#endif
+
+/* 写入的数据与flash中当前的数据完全相同时是否跳过写入(1:开启 0:关闭)
+ * 开启后每次写入先比较大小，大小相同再读出数据比较内容，重复保存相同的数据不再占用数据区和重写区 */
+#ifndef EE_USE_SKIP_UNCHANGED
+#define EE_USE_SKIP_UNCHANGED 0
+#endif
+
+/* 是否压缩保存数据(1:开启 0:关闭)，适合大部分是0的结构体、查找表、字符串等重复较多的数据
+ * 开启后ee_writeDataToFlash()写入前用游程编码压缩数据，压缩后更小时才保存压缩的数据，读取时自动解压
+ * 索引中数据大小的最高位用作压缩标志，因此单个数据最大大小减半，超过时ee_writeDataToFlash()返回4 */
+#ifndef EE_USE_COMPRESS
+#define EE_USE_COMPRESS 0
+#endif
+
+/* 压缩缓冲区大小(单位:byte)，压缩后超过这个大小的数据不压缩 */
+#ifndef EE_COMPRESS_BUF_SIZE
+#define EE_COMPRESS_BUF_SIZE 256
+#endif
+
+/* 是否开启批量写入ee_writeBatchToFlash()(1:开启 0:关闭)
+ * 一次写入的多个数据共用一次重写计数更新和一个提交标记，断电后要么全部生效，要么全部保持写入前的内容 */
+#ifndef EE_USE_BATCH_WRITE
+#define EE_USE_BATCH_WRITE 0
+#endif
+
+/* 批量写入一次最多写入的数据个数，每个数据额外占用2字节RAM */
+#ifndef EE_BATCH_MAX_NUM
+#define EE_BATCH_MAX_NUM 32
+#endif
+
+/* 是否开启写合并(1:开启 0:关闭)，适合每次写入都有固定开销的spi flash
+ * 开启后数据区的连续写入先放在一页大小的RAM缓冲区中，同一页内相连的写入合并为一次写操作，写入不会跨页
+ * 只合并还没有被索引引用的数据字节、批量写入的id表和批量覆盖的索引，单次ee_writeDataToFlash()的状态、索引、计数和链接
+ * 仍然分开写入(掉电安全需要这个顺序)，不会减少写操作次数：test/bench中8个数据开启EE_USE_INDEX_TABLE时每次写入的写操作次数
+ * 1~16字节数据关闭时7.03次、开启时7.13次，200~400字节数据关闭时7.28次、开启时8.48次(合并后的写入不跨页，跨页的数据分多次写)，
+ * make -C test bench输出的driver calls per write一行是每次写入调用驱动函数的次数 */
+#ifndef EE_USE_WRITE_COMBINE
+#define EE_USE_WRITE_COMBINE 0
+#endif
+
+/* 是否提供直接指向flash中数据的指针(1:开启 0:关闭)，适合片内flash或者内存映射模式的qspi flash
+ * 开启后可以通过ee_getDataPointer()直接访问数据，不需要拷贝到RAM，数据所在扇区被擦除后指针失效，通过ee_getGeneration()判断 */
+#ifndef EE_USE_XIP
+#define EE_USE_XIP 0
+#endif
+
+/* flash地址0在CPU地址空间中的位置，flash地址加上它就是可以直接访问的地址，例如((ee_uint8 *)0x08000000) */
+#ifndef EE_XIP_BASE
+#define EE_XIP_BASE 0
+#endif
+
+/* 是否开启RAM读缓存(1:开启 0:关闭)
+ * 读过的数据保存在RAM中，再次读取时不访问flash，缓存满时淘汰最久没有读取且没有被锁定的一项 */
+#ifndef EE_USE_READ_CACHE
+#define EE_USE_READ_CACHE 0
+#endif
+
+/* 读缓存的项数，每项额外占用EE_READ_CACHE_DATA_SIZE + 12字节RAM */
+#ifndef EE_READ_CACHE_NUM
+#define EE_READ_CACHE_NUM 4
+#endif
+
+/* 读缓存每项能保存的最大数据大小(单位:byte)，更大的数据不缓存 */
+#ifndef EE_READ_CACHE_DATA_SIZE
+#define EE_READ_CACHE_DATA_SIZE 32
+#endif
+
+/* 是否在重写区中保存索引检查点(1:开启 0:关闭)，需要开启EE_USE_INDEX_TABLE
+ * 检查点保存每个数据最新索引的位置，初始化时只需要从检查点开始遍历重写链，重写链很长时可以加快挂载 */
+#ifndef EE_USE_CHECKPOINT
+#define EE_USE_CHECKPOINT 0
+#endif
+
+/* 重写区每新增多少个索引写入一次检查点，每个检查点占用(DATA_NUM + 2) / 3 + 1个索引的空间 */
+#ifndef EE_CHECKPOINT_INTERVAL
+#define EE_CHECKPOINT_INTERVAL 64
+#endif
+
+/* 是否支持多个任务同时访问(1:开启 0:关闭)，不能和EE_USE_READ_CACHE同时开启
+ * 写操作之间通过ee_writeLock/ee_writeUnlock互斥；读操作不加锁，可以同时进行，
+ * 读取期间有写操作修改了RAM索引表或交换了区域时重新读取，只有正在交换区域时才需要等待
+ * NOTE: 读操作会在写入方写入或擦除flash的同时调用ee_flashRead，驱动函数必须可以同时调用，
+ *       否则需要在驱动函数内部加锁串行执行(例如共用一条spi总线)；flash在写入或擦除期间不能读取时，驱动中的读函数要先等待完成
+ *       开启EE_USE_OP_COUNTER时读操作的计数没有加锁，多个任务同时读取时可能少计 */
+#ifndef EE_USE_LOCK
+#define EE_USE_LOCK 0
+#endif
+
+/* 写操作加锁和解锁的函数名(例如RTOS的互斥量)，函数原型 void (*) (void) */
+#ifndef ee_writeLock
+#define ee_writeLock
+#endif
+#ifndef ee_writeUnlock
+#define ee_writeUnlock
+#endif
+
+/* 读操作等待区域交换完成时调用，可以让出CPU(例如RTOS的延时函数)，不填写时忙等待 */
+#ifndef ee_readYield
+#define ee_readYield()
+#endif
+
+/* 多核处理器需要填写内存屏障，单核时不需要填写 */
+#ifndef ee_memoryBarrier
+#define ee_memoryBarrier()
+#endif
+
+/* 区域交换时搬运数据的缓冲区大小(单位:byte)，建议为FLASH_PAGE_SIZE的整数倍 */
+#ifndef EE_COPY_BUF_SIZE
+#define EE_COPY_BUF_SIZE 256
+#endif
+
+/* 是否统计flash驱动的操作次数和字节数(1:开启 0:关闭)，用于评估和比较性能 */
+#ifndef EE_USE_OP_COUNTER
+#define EE_USE_OP_COUNTER 0
+#endif
+
+/* 是否统计写放大、回收和每个扇区的擦除次数(1:开启 0:关闭)，用于估算区域大小和flash寿命
+ * 统计结果在区域交换后保留，不随ee_flashInit清零，需要跨复位累计时由用户保存并通过ee_setStats()恢复 */
+#ifndef EE_USE_STATS
+#define EE_USE_STATS 0
+#endif
+
+/* 统计擦除次数的扇区个数，扇区按索引区(地址小的在前)、数据区(地址小的在前)的顺序编号，超出的扇区不统计 */
+#ifndef EE_STATS_SECTOR_NUM
+#define EE_STATS_SECTOR_NUM 32
+#endif
+
+/* 统计回收耗时用的时钟(例如毫秒tick)，函数原型 ee_uint32 (*) (void)，不填写时不统计耗时 */
+#ifndef ee_getTick
+#define ee_getTick() 0
+#endif
+
+/* 想保存变量到flash时，首先在下面枚举中添加变量名
+ * 如果在EE_CONFIG_FILE中已经定义了variableLists，定义宏EE_USER_VARIABLE_LISTS即可 */
+#ifndef EE_USER_VARIABLE_LISTS
+typedef enum
+{
+    // DATA0,DATA1,G_MYSENSORDATA只是示例，实际使用时将这三个示例全部删除
+    DATA0,
+    DATA1,
+    // 用户将变量名添加到下面
+    G_MYSENSORDATA,
+
+    // DATA_NUM用于标识flash中一共存了多少个数据(不允许删改)
+    DATA_NUM,
+} variableLists;
+#endif
+
+#if EE_USE_BATCH_WRITE
+/* 批量写入中的一个数据 */
+typedef struct
+{
+    /* 要写入的数据id(详见枚举类型variableLists) */
+    variableLists dataId;
+    /* 写入数据的地址 */
+    void *buf;
+    /* 数据大小 */
+    ee_size_t bufSize;
+} ee_batchItem_t;
+#endif
+
+#if EE_USE_ASYNC_WRITE
+/* ee_poll()返回此值时写入还没有完成 */
+#define EE_WRITE_PENDING 0xFF
+
+/* ee_writeStart()启动的一次写入，由调用者分配，完成之前不能释放，也不能修改写入的数据 */
+typedef struct
+{
+    /* 要写入的数据id(详见枚举类型variableLists) */
+    variableLists dataId;
+    /* 写入数据的地址 */
+    void *buf;
+    /* 数据大小 */
+    ee_size_t bufSize;
+    /* EE_WRITE_PENDING: 还没有完成 其他: 与ee_writeDataToFlash()的返回值相同 */
+    ee_uint8 result;
+} ee_writeHandle_t;
+#endif
+
+#if EE_USE_OP_COUNTER
+/* flash驱动操作统计 */
+typedef struct
+{
+    /* 读操作次数 */
+    ee_uint32 readCount;
+    /* 读取的总字节数 */
+    ee_uint32 readBytes;
+    /* 写操作次数 */
+    ee_uint32 writeCount;
+    /* 写入的总字节数 */
+    ee_uint32 writeBytes;
+    /* 扇区擦除次数 */
+    ee_uint32 eraseCount;
+} ee_opCounter_t;
+#endif
+
+#if EE_USE_STATS
+/* 写放大和磨损统计 */
+typedef struct
+{
+    /* 成功写入的用户数据字节数(压缩前，内容没有变化跳过的写入不计入) */
+    ee_uint32 logicalBytes;
+    /* 实际写入flash的字节数(包括状态、索引和回收时写入的数据) */
+    ee_uint32 physicalBytes;
+    /* 回收时写入flash的字节数 */
+    ee_uint32 gcBytes;
+    /* 回收次数(完成的区域交换次数，数据环模式再加上回收的扇区数) */
+    ee_uint32 gcCount;
+    /* 回收的总耗时(ee_getTick()的计数) */
+    ee_uint32 gcTicks;
+    /* 每个扇区的擦除次数 */
+    ee_uint32 eraseCount[EE_STATS_SECTOR_NUM];
+} ee_stats_t;
+#endif
+
+#if EE_USE_READ_CACHE
+/* 读缓存中的一项，用户不要修改 */
+typedef struct
+{
+    /* 是否保存了数据，为0时是空闲项 */
+    ee_uint8 used;
+    /* 缓存的数据id */
+    ee_uint16 dataId;
+    /* 缓存的数据大小 */
+    ee_size_t dataSize;
+    /* 最后一次读取时的计数，用于淘汰最久没有读取的一项 */
+    ee_uint32 lastUse;
+    /* 被锁定的项不会被淘汰 */
+    ee_uint8 pinned;
+    /* 缓存的数据 */
+    ee_uint8 data[EE_READ_CACHE_DATA_SIZE];
+} ee_cacheEntry_t;
+#endif
+
+#if EE_USE_INDEX_TABLE
+/* RAM索引表中的一项，用户不要修改 */
+typedef struct
+{
+    /* 当前数据最新索引的地址(直接访问地址)，没有有效数据时为0xFFFFFFFF */
+    ee_uint32 indexAddr;
+    /* 当前数据大小 */
+    ee_size_t dataSize;
+    /* 当前数据在数据区的地址(相对于dataStartAddr的偏移地址) */
+    ee_size_t dataAddr;
+} ee_indexTable_t;
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+/* 一个存储实例使用的flash驱动函数 */
+typedef struct
+{
+    /* 写flash，num不超过0xFFFF */
+    void (*write)(ee_uint32 flashAddr, ee_uint8 *buf, ee_uint16 num);
+    /* 读flash，num不超过0xFFFF */
+    void (*read)(ee_uint32 flashAddr, ee_uint8 *buf, ee_uint16 num);
+    /* 擦除flashAddr所在的扇区 */
+    void (*eraseSector)(ee_uint32 flashAddr);
+} ee_flashDriver_t;
+#endif
 
 /* 用户不要修改结构体中的任何成员 */
 typedef struct
@@ -62,21 +442,112 @@ typedef struct
     ee_uint16 dataRegionSize;
     /* 索引重写计数区总大小(单位:字节) */
     ee_uint16 overwriteCountAreaSize;
+    /* 数据区写入游标(相对于dataStartAddr的偏移地址) */
+    ee_uint32 dataFreeAddr;
+    /* 重写区写入游标(直接访问地址) */
+    ee_uint32 overwriteFreeAddr;
+#if EE_USE_DATA_RING
+    /* 数据环当前写入的扇区 */
+    ee_uint16 dataHeadSector;
+    /* 数据环中最旧的扇区，空间不足时首先回收 */
+    ee_uint16 dataTailSector;
+    /* 数据环当前写入扇区的序号 */
+    ee_uint32 dataHeadSeq;
+#if EE_USE_HOT_COLD
+    /* 空闲扇区的个数 */
+    ee_uint16 dataFreeSectorNum;
+    /* 当前写入冷数据的扇区，0xFFFF表示还没有 */
+    ee_uint16 dataColdSector;
+    /* 冷数据扇区写入游标(相对于dataStartAddr的偏移地址) */
+    ee_uint32 dataColdFreeAddr;
+    /* 为1时头扇区和冷数据扇区已经交换，正在搬移回收的数据 */
+    ee_uint8 dataColdWriting;
+#endif
+#endif
+#if EE_USE_INCREMENTAL_GC && !EE_USE_DATA_RING
+    /* 增量垃圾回收当前所处的阶段 */
+    ee_uint8 gcState;
+    /* 擦除阶段下一个要检查的交换区扇区 */
+    ee_uint16 gcSector;
+    /* 拷贝阶段下一个要拷贝的数据id */
+    ee_uint16 gcCopyId;
+    /* 交换数据区写入游标(相对于dataSwapStartAddr的偏移地址) */
+    ee_uint32 gcDataAddr;
+    /* 交换区重写区写入游标(直接访问地址) */
+    ee_uint32 gcOverwriteFreeAddr;
+    /* 拷贝到交换区之后又被重写的数据，每个数据占1位 */
+    ee_uint8 gcDirty[(DATA_NUM + 7) / 8];
+#endif
+#if EE_USE_ASYNC_ERASE
+    /* 是否有已经启动但可能还没有完成的擦除 */
+    ee_uint8 eraseBusy;
+#endif
+#if EE_USE_LOCK
+    /* 读写序号，写操作修改读操作用到的状态期间为奇数 */
+    volatile ee_uint32 seq;
+    /* 写操作修改状态的嵌套层数 */
+    ee_uint8 seqDepth;
+#endif
+#if EE_USE_INDEX_TABLE
+    /* 每个数据最新索引的RAM副本，在ee_flashInit中建立 */
+    ee_indexTable_t indexTable[DATA_NUM];
+#endif
+#if EE_USE_CHECKPOINT
+    /* 最近一个检查点之后的重写区地址(直接访问地址) */
+    ee_uint32 checkpointAddr;
+#endif
+#if EE_USE_READ_CACHE
+    /* 读缓存，在ee_flashInit中清空 */
+    ee_cacheEntry_t cache[EE_READ_CACHE_NUM];
+    /* 读缓存的访问计数 */
+    ee_uint32 cacheTick;
+    /* 读缓存命中次数 */
+    ee_uint32 cacheHits;
+    /* 读缓存未命中次数 */
+    ee_uint32 cacheMisses;
+#endif
+#if EE_USE_OP_COUNTER
+    /* flash驱动操作统计，ee_flashInit时清零 */
+    ee_opCounter_t opCounter;
+#endif
+#if EE_USE_MULTI_INSTANCE
+    /* 本实例的flash驱动函数 */
+    ee_flashDriver_t *driver;
+    /* 本实例使用的数据个数，只有id小于它的数据可以读写 */
+    ee_uint16 dataNum;
+    /* 区域交换时搬运数据使用的缓冲区，挂载时也用来成块读取索引区 */
+    ee_uint32 copyBuffer[(EE_COPY_BUF_SIZE + 3) / 4];
+#if EE_USE_COMPRESS
+    /* 写入前压缩数据使用的缓冲区，开头保存原始大小 */
+    ee_uint32 compressBuffer[(EE_COMPRESS_BUF_SIZE + 3) / 4];
+#endif
+#if EE_USE_BATCH_WRITE
+    /* 批量写入的编号表 */
+    ee_uint16 batchIdList[EE_BATCH_MAX_NUM + 1];
+#endif
+#endif
+#if EE_USE_WRITE_COMBINE
+    /* 写合并缓冲区，保存还没有写入flash的一段连续数据(不跨页) */
+    ee_uint8 combineBuffer[FLASH_PAGE_SIZE];
+    /* 写合并缓冲区中数据的flash地址 */
+    ee_uint32 combineAddr;
+    /* 写合并缓冲区中数据的长度 */
+    ee_uint16 combineLen;
+#endif
+#if EE_USE_XIP
+    /* 数据指针的代数，每次擦除前加1 */
+    volatile ee_uint32 xipGeneration;
+#endif
+#if EE_USE_STATS
+    /* 写放大和磨损统计，ee_flashInit时不清零 */
+    ee_stats_t stats;
+    /* 回收的嵌套深度，大于0时写入的字节计入gcBytes */
+    ee_uint8 statsGcDepth;
+    /* 最外层回收开始时的时钟 */
+    ee_uint32 statsGcStart;
+#endif
 } ee_flash_t;
 
-/* 想保存变量到flash时，首先在下面枚举中添加变量名 */
-typedef enum
-{
-    // DATA0,DATA1,G_MYSENSORDATA只是示例，实际使用将71-75行全部删除
-    DATA0,
-    DATA1,
-    // 用户将变量名添加到下面
-    G_MYSENSORDATA,
-
-    // DATA_NUM用于标识flash中一共存了多少个数据(不允许删改)
-    DATA_NUM,
-} variableLists;
-
 /**
  * @brief                      格式化传入函数地址flash
  *
@@ -86,7 +557,7 @@ typedef enum
  * @param indexRegionSize      总索引区大小(单位：扇区)
  * @param indexSize            索引区大小(详见README图例，要小于indexRegionSize)
  * @param dataStartAddr        数据区起始地址
- * @param dataSwapStartAddr    交换数据区起始地址
+ * @param dataSwapStartAddr    交换数据区起始地址(开启EE_USE_DATA_RING时不使用)
  * @param dataRegionSize       数据区大小(单位：扇区)
  */
 void ee_flashInit(ee_flash_t *pobj, ee_uint32 indexStartAddr, ee_uint32 indexSwapStartAddr, ee_uint16 indexRegionSize, ee_uint16 indexSize, ee_uint32 dataStartAddr, ee_uint32 dataSwapStartAddr, ee_uint16 dataRegionSize);
@@ -105,6 +576,37 @@ void ee_flashInit(ee_flash_t *pobj, ee_uint32 indexStartAddr, ee_uint32 indexSwa
  */
 ee_uint8 ee_readDataFromFlash(ee_flash_t *pobj, void *buf, variableLists dataId);
 
+/**
+ * @brief        获取数据当前的大小，可以在读取前确定需要的缓冲区大小
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要查询的数据id(详见头文件枚举类型variableLists)
+ * @param psize  保存数据大小的地址
+ *
+ * @retval       0: 获取成功
+ *               1: 查询的数据超过索引区
+ *               2: 当前查询的数据id没有写入过
+ *               3: 当前查询的数据id不是有效的
+ */
+ee_uint8 ee_getDataSize(ee_flash_t *pobj, variableLists dataId, ee_size_t *psize);
+
+/**
+ * @brief        从flash读取数据中的一段，只需要数据中的一部分时不用读出整个数据
+ *
+ * @param pobj   flash管理对象指针
+ * @param buf    读取数据的地址
+ * @param dataId 要读取的数据id(详见头文件枚举类型variableLists)
+ * @param offset 读取的起始位置(相对于数据开头的字节数)
+ * @param len    读取的字节数
+ *
+ * @retval       0: 读取成功
+ *               1: 读取的数据超过索引区
+ *               2: 当前读取的数据id没有写入过
+ *               3: 当前读取的数据id不是有效的
+ *               4: 读取的范围超过了数据的大小
+ */
+ee_uint8 ee_readDataRange(ee_flash_t *pobj, void *buf, variableLists dataId, ee_size_t offset, ee_size_t len);
+
 /**
  * @brief         写数据到flash
  *
@@ -115,8 +617,200 @@ ee_uint8 ee_readDataFromFlash(ee_flash_t *pobj, void *buf, variableLists dataId)
  *
  * @retval        0: 写入成功
  *                1: 写入的数据超过索引区
- *                2: 当前写入的数据id，没有遵循variableLists中的顺序写入
+ *                3: 数据区剩余空间不足
+ *                4: 开启EE_USE_COMPRESS时数据大小占用了压缩标志位(超过ee_size_t最大值的一半)
+ */
+ee_uint8 ee_writeDataToFlash(ee_flash_t *pobj, void *buf, ee_size_t bufSize, variableLists dataId);
+
+#if EE_USE_BATCH_WRITE
+/**
+ * @brief         一次写入多个数据到flash，所有数据同时生效
+ *
+ * @param pobj    flash管理对象指针
+ * @param items   要写入的数据数组，同一个id出现多次时最后一个有效
+ * @param itemNum 数据个数
+ *
+ * @retval        0: 写入成功
+ *                1: 写入的数据超过索引区
+ *                3: 数据区剩余空间不足
+ *                4: 数据个数超过EE_BATCH_MAX_NUM
+ *
+ * @note          提交之前断电时，批量写入中第一次写入的数据索引停留在invalid状态，
+ *                读取这些数据返回3(而不是2)，再次写入后恢复正常
+ */
+ee_uint8 ee_writeBatchToFlash(ee_flash_t *pobj, ee_batchItem_t *items, ee_uint16 itemNum);
+#endif
+
+#if EE_USE_INCREMENTAL_GC
+/**
+ * @brief        执行一步垃圾回收，适合在空闲时周期调用
+ *
+ * @param pobj   flash管理对象指针
+ * @param budget 本次最多执行的工作量，每个单位为检查并擦除一个扇区、拷贝一个数据或回收一个数据环扇区
+ *
+ * @retval       0: 当前没有需要进行的回收工作
+ *               1: 回收工作还没有完成
+ */
+ee_uint8 ee_gcStep(ee_flash_t *pobj, ee_uint16 budget);
+#endif
+
+#if EE_USE_ASYNC_ERASE
+/**
+ * @brief        查询ee_gcStep()启动的擦除是否还在进行，擦除期间调用其他接口会等待擦除完成
+ *
+ * @param pobj   flash管理对象指针
+ *
+ * @retval       0: 没有正在进行的擦除
+ *               1: 擦除还在进行
+ */
+ee_uint8 ee_isBusy(ee_flash_t *pobj);
+#endif
+
+#if EE_USE_ASYNC_WRITE
+/**
+ * @brief         启动一次写入后立即返回，之后调用ee_poll()完成写入
+ *
+ * @param pobj    flash管理对象指针
+ * @param phandle 这次写入的句柄，由调用者分配
+ * @param buf     写入数据的地址
+ * @param bufSize 数据大小
+ * @param dataId  要写入的数据id(详见头文件枚举类型variableLists)
+ *
+ * @retval        0: 已经登记，等待ee_poll()完成
+ *                1: 写入的数据超过索引区
+ *                4: 开启EE_USE_COMPRESS时数据大小占用了压缩标志位(超过ee_size_t最大值的一半)
+ *
+ * @note          返回非0时句柄中的结果就是这个返回值，不需要再调用ee_poll()
+ */
+ee_uint8 ee_writeStart(ee_flash_t *pobj, ee_writeHandle_t *phandle, void *buf, ee_size_t bufSize, variableLists dataId);
+
+/**
+ * @brief         推进ee_writeStart()启动的写入，不等待擦除完成
+ *
+ * @param pobj    flash管理对象指针
+ * @param phandle ee_writeStart()使用的句柄
+ *
+ * @retval        EE_WRITE_PENDING: 还没有完成(擦除还在进行或者正在回收空间)，之后再次调用
+ *                其他: 已经完成，返回值与ee_writeDataToFlash()相同
+ *
+ * @note          可以同时有多个还没有完成的句柄，分别调用ee_poll()，同一个数据的多次写入按完成的顺序生效
+ */
+ee_uint8 ee_poll(ee_flash_t *pobj, ee_writeHandle_t *phandle);
+#endif
+
+#if EE_USE_READ_CACHE
+/**
+ * @brief        将数据读入读缓存并锁定，之后不会被淘汰(需要在ee_flashInit之后调用)
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要锁定的数据id(详见头文件枚举类型variableLists)
+ *
+ * @retval       0: 锁定成功
+ *               1: 数据超过索引区
+ *               2: 当前数据id没有写入过
+ *               3: 当前数据id不是有效的
+ *               4: 数据大于EE_READ_CACHE_DATA_SIZE，或者所有缓存项都已经被锁定
+ */
+ee_uint8 ee_pinDataInCache(ee_flash_t *pobj, variableLists dataId);
+
+/**
+ * @brief        解除数据在读缓存中的锁定，数据仍然保留在缓存中
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要解除锁定的数据id(详见头文件枚举类型variableLists)
+ */
+void ee_unpinDataInCache(ee_flash_t *pobj, variableLists dataId);
+
+/**
+ * @brief         获取读缓存的命中和未命中次数(从ee_flashInit开始)
+ *
+ * @param pobj    flash管理对象指针
+ * @param phits   保存命中次数的地址
+ * @param pmisses 保存未命中次数的地址
+ *
+ * @note          三个读接口命中时都计入命中次数；未命中只统计ee_readDataFromFlash()，只有它会把读出的数据放入缓存
+ */
+void ee_getCacheStats(ee_flash_t *pobj, ee_uint32 *phits, ee_uint32 *pmisses);
+#endif
+
+#if EE_USE_OP_COUNTER
+/**
+ * @brief          获取flash驱动操作统计(从上一次清零开始)
+ *
+ * @param pobj     flash管理对象指针
+ * @param pcounter 保存统计结果的地址
+ */
+void ee_getOpCounter(ee_flash_t *pobj, ee_opCounter_t *pcounter);
+
+/**
+ * @brief      清零flash驱动操作统计
+ *
+ * @param pobj flash管理对象指针
+ */
+void ee_clearOpCounter(ee_flash_t *pobj);
+#endif
+
+#if EE_USE_STATS
+/**
+ * @brief        获取写放大和磨损统计
+ *
+ * @param pobj   flash管理对象指针
+ * @param pstats 保存统计结果的地址
+ */
+void ee_getStats(ee_flash_t *pobj, ee_stats_t *pstats);
+
+/**
+ * @brief        设置写放大和磨损统计，在ee_flashInit之前调用可以恢复复位前保存的统计结果
+ *
+ * @param pobj   flash管理对象指针
+ * @param pstats 统计结果的地址，为NULL时清零
+ */
+void ee_setStats(ee_flash_t *pobj, ee_stats_t *pstats);
+#endif
+
+#if EE_USE_MULTI_INSTANCE
+/**
+ * @brief         设置存储实例的驱动函数和数据个数(需要在ee_flashInit之前调用)
+ *
+ * @param pobj    flash管理对象指针
+ * @param pdriver 本实例的驱动函数，调用后不能释放
+ * @param dataNum 本实例的数据个数，可以读写的id为0 ~ dataNum-1，超过DATA_NUM时按DATA_NUM
+ *
+ * @note          各实例的id互相独立，不同实例的同一个id是不同的数据，可以为每个实例定义自己的枚举并转换为variableLists使用，
+ *                此时DATA_NUM要不小于所有实例中最大的数据个数
+ */
+void ee_setInstance(ee_flash_t *pobj, ee_flashDriver_t *pdriver, ee_uint16 dataNum);
+#endif
+
+#if EE_USE_XIP
+/**
+ * @brief        获取直接指向flash中数据的指针(需要在ee_flashInit之后调用)
+ *
+ * @param pobj   flash管理对象指针
+ * @param dataId 要读取的数据id(详见头文件枚举类型variableLists)
+ * @param pdata  保存数据指针的地址，指针只能用来读
+ * @param psize  保存数据大小的地址
+ *
+ * @retval       0: 获取成功
+ *               1: 读取的数据超过索引区
+ *               2: 当前读取的数据id没有写入过
+ *               3: 当前读取的数据id不是有效的
+ *               4: 数据是压缩保存的，只能通过ee_readDataFromFlash()读取
+ *
+ * @note         重写这个数据后指针仍然指向旧的数据，需要重新获取
+ */
+ee_uint8 ee_getDataPointer(ee_flash_t *pobj, variableLists dataId, const void **pdata, ee_size_t *psize);
+
+/**
+ * @brief      获取数据指针的代数，每次擦除扇区前加1
+ *
+ * @param pobj flash管理对象指针
+ *
+ * @return     代数，和获取指针时的代数不同时说明指针指向的数据可能已经被擦除，需要重新获取指针
+ *
+ * @note       在获取指针前和使用数据后各调用一次，两次相同说明使用期间数据没有被擦除
  */
-ee_uint8 ee_writeDataToFlash(ee_flash_t *pobj, void *buf, ee_uint16 bufSize, variableLists dataId);
+ee_uint32 ee_getGeneration(ee_flash_t *pobj);
+#endif
 
 #endif /* __FLASH_EMULATEEEPROM_H_ */
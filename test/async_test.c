@@ -0,0 +1,265 @@
+/**
+ * @file async_test.c
+ * @brief 异步擦除测试：擦除由驱动中的工作线程完成，经过真实的等待时间后才结束
+ * @note  检查ee_gcStep()启动擦除后不等待直接返回，擦除期间CPU可以做其他事情；
+ *        擦除期间调用写入、读取和ee_flashInit()时，库先等待擦除完成再访问flash(驱动统计的擦除期间访问次数为0)；
+ *        开启EE_USE_ASYNC_WRITE时再只用ee_writeStart()和ee_poll()写入，不调用ee_gcStep()，检查回收由ee_poll()推进，
+ *        ee_poll()不等待擦除，也不进行同步擦除
+ *        用法: async_test [写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_emulateEEprom.h"
+
+#define ASYNC_INDEX_SECTORS 2
+/* 数据环在使用率达到EE_GC_THRESHOLD时才由ee_gcStep()回收，扇区太少时都在写入时回收 */
+#define ASYNC_DATA_SECTORS  8
+#define ASYNC_FLASH_SECTORS (2 * ASYNC_INDEX_SECTORS + 2 * ASYNC_DATA_SECTORS)
+#define ASYNC_MAX_SIZE      64
+/* 工作线程擦除一个扇区的时间(单位:us) */
+#define ASYNC_ERASE_US      5000
+
+static ee_flash_t fm;
+static unsigned int randomState = 1;
+static unsigned char values[DATA_NUM][ASYNC_MAX_SIZE];
+static int valueSizes[DATA_NUM];
+
+static unsigned int nextRandom(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+
+    return (randomState >> 8) & 0xFFFFFF;
+}
+
+static double nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void mount(void)
+{
+    ee_flashInit(&fm, SECTORS(0), SECTORS(ASYNC_INDEX_SECTORS), ASYNC_INDEX_SECTORS, 1,
+                 SECTORS(2 * ASYNC_INDEX_SECTORS), SECTORS(2 * ASYNC_INDEX_SECTORS + ASYNC_DATA_SECTORS), ASYNC_DATA_SECTORS);
+}
+
+static void writeRandom(void)
+{
+    int i, id = nextRandom() % DATA_NUM;
+    int size = 1 + nextRandom() % ASYNC_MAX_SIZE;
+
+    for (i = 0; i < size; i++)
+        values[id][i] = (unsigned char)nextRandom();
+    valueSizes[id] = size;
+
+    if (ee_writeDataToFlash(&fm, values[id], (ee_size_t)size, (variableLists)id))
+    {
+        printf("FAIL: write id %d\n", id);
+        exit(1);
+    }
+}
+
+static void verify(const char* where)
+{
+    unsigned char buf[ASYNC_MAX_SIZE];
+    int id;
+
+    for (id = 0; id < DATA_NUM; id++)
+    {
+        if (valueSizes[id] == 0)
+            continue;
+
+        if (ee_readDataFromFlash(&fm, buf, (variableLists)id) || memcmp(buf, values[id], valueSizes[id]))
+        {
+            printf("FAIL %s: id %d\n", where, id);
+            exit(1);
+        }
+    }
+}
+
+#if EE_USE_ASYNC_WRITE
+/**
+ * @brief: 只通过ee_writeStart()和ee_poll()写入writeNum个随机数据
+ */
+static void asyncWrites(int writeNum)
+{
+    ee_writeHandle_t handle;
+    thread_driverStats_t before, after;
+    unsigned long polls = 0, pendingPolls = 0, erasingPolls = 0;
+    double maxPollUs = 0;
+    int n, i;
+
+    thread_driverGetStats(&before);
+
+    for (n = 0; n < writeNum; n++)
+    {
+        int id = nextRandom() % DATA_NUM;
+        int size = 1 + nextRandom() % ASYNC_MAX_SIZE;
+        ee_uint8 ret;
+
+        /* 写入完成之前不修改values[id] */
+        for (i = 0; i < size; i++)
+            values[id][i] = (unsigned char)nextRandom();
+        valueSizes[id] = size;
+
+        if (ee_writeStart(&fm, &handle, values[id], (ee_size_t)size, (variableLists)id))
+        {
+            printf("FAIL: ee_writeStart() id %d\n", id);
+            exit(1);
+        }
+
+        do
+        {
+            double start = nowUs();
+            double pollUs;
+
+            ret = ee_poll(&fm, &handle);
+            pollUs = nowUs() - start;
+
+            polls++;
+            if (pollUs > maxPollUs)
+                maxPollUs = pollUs;
+
+            if (ret == EE_WRITE_PENDING)
+            {
+                pendingPolls++;
+
+                /* 擦除期间CPU做其他事情，之后再查询 */
+                if (ee_isBusy(&fm))
+                    erasingPolls++;
+            }
+        } while (ret == EE_WRITE_PENDING);
+
+        if (ret != 0)
+        {
+            printf("FAIL: ee_poll() id %d returned %d\n", id, ret);
+            exit(1);
+        }
+
+        if (n % 100 == 0)
+            verify("after async write");
+    }
+
+    thread_driverGetStats(&after);
+
+    printf("async write: writes=%d polls=%lu pending=%lu while erasing=%lu (max %.0fus, erase %dus) async erases=%lu sync erases=%lu\n",
+           writeNum, polls, pendingPolls, erasingPolls, maxPollUs, ASYNC_ERASE_US,
+           after.asyncErases - before.asyncErases, after.syncErases - before.syncErases);
+
+    if ((after.asyncErases == before.asyncErases) || (erasingPolls == 0))
+    {
+        printf("FAIL: ee_poll() never returned while an erase was running\n");
+        exit(1);
+    }
+
+    if (after.syncErases != before.syncErases)
+    {
+        printf("FAIL: ee_poll() erased a sector synchronously\n");
+        exit(1);
+    }
+
+    /* ee_poll()不等待擦除完成，返回时间远小于擦除时间 */
+    if (maxPollUs > ASYNC_ERASE_US / 2)
+    {
+        printf("FAIL: ee_poll() waited for the erase\n");
+        exit(1);
+    }
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    int n, writeNum = (argc > 1) ? atoi(argv[1]) : 2000;
+    unsigned long gcCalls = 0, busyReturns = 0, otherWork = 0, busyWrites = 0;
+    double maxStepUs = 0;
+    thread_driverStats_t stats;
+
+    nor_simInit(SECTORS(ASYNC_FLASH_SECTORS), 0);
+    thread_driverStart(ASYNC_ERASE_US);
+    mount();
+
+    for (n = 0; n < writeNum; n++)
+    {
+        int k;
+
+        writeRandom();
+
+        /* 空闲时做一点回收工作，擦除期间CPU做其他事情 */
+        for (k = 0; k < 4; k++)
+        {
+            double start = nowUs();
+            ee_uint8 ret = ee_gcStep(&fm, 1);
+            double stepUs = nowUs() - start;
+
+            gcCalls++;
+
+            if (ee_isBusy(&fm))
+            {
+                /* 启动擦除的调用或者擦除期间的调用都应该立即返回 */
+                busyReturns++;
+                if (stepUs > maxStepUs)
+                    maxStepUs = stepUs;
+
+                /* 一部分擦除不等它完成，直接写入下一个数据，写入时库需要先等待擦除完成 */
+                if (nextRandom() % 4 == 0)
+                {
+                    writeRandom();
+                    busyWrites++;
+                }
+
+                while (ee_isBusy(&fm))
+                    otherWork++;
+            }
+
+            if (ret == 0)
+                break;
+        }
+
+        if (n % 100 == 0)
+            verify("after write");
+    }
+
+#if EE_USE_ASYNC_WRITE
+    asyncWrites(writeNum);
+#endif
+
+    /* 擦除期间重新挂载 */
+    ee_gcStep(&fm, 1);
+    mount();
+    verify("after remount");
+
+    thread_driverStop();
+    thread_driverGetStats(&stats);
+
+    printf("async: writes=%d gcStep calls=%lu returned while erasing=%lu (max %.0fus, erase %dus) writes during erase=%lu async erases=%lu accesses during erase=%lu\n",
+           writeNum, gcCalls, busyReturns, maxStepUs, ASYNC_ERASE_US, busyWrites, stats.asyncErases, stats.busyAccesses);
+
+    if ((stats.asyncErases == 0) || (busyReturns == 0) || (otherWork == 0))
+    {
+        printf("FAIL: no erase was run asynchronously\n");
+        return 1;
+    }
+
+    if (stats.busyAccesses != 0)
+    {
+        printf("FAIL: flash was accessed while an erase was in progress\n");
+        return 1;
+    }
+
+    /* ee_gcStep()不等待擦除完成，返回时间远小于擦除时间 */
+    if (maxStepUs > ASYNC_ERASE_US / 2)
+    {
+        printf("FAIL: ee_gcStep() waited for the erase\n");
+        return 1;
+    }
+
+    nor_simDeinit();
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file bench.c
+ * @brief 在模拟flash上运行几种典型的写入负载，按延时模型统计吞吐量、写入延时分布和每个扇区的擦除次数
+ * @note  用法: bench [每种负载的写入次数]，编译时用-D开启可选功能，比较开启前后的结果
+ *        每种负载还输出ee_writeDataToFlash()中平均每次写入调用驱动函数(写、读、擦除)的次数，包含写入中进行的区域交换
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emulateEEprom.h"
+
+#define BENCH_INDEX_SECTORS 2
+#define BENCH_DATA_SECTORS  8
+#define BENCH_FLASH_SECTORS (2 * BENCH_INDEX_SECTORS + 2 * BENCH_DATA_SECTORS)
+#define BENCH_MAX_SIZE      400
+
+typedef struct
+{
+    const char* name;
+    /* 数据大小范围 */
+    int minSize;
+    int maxSize;
+    /* 写入热点数据(前两个id)的百分比，0表示所有id均匀写入 */
+    int hotPercent;
+} benchLoad_t;
+
+static const benchLoad_t benchLoads[] =
+{
+    { "small-uniform", 4, 32, 0 },
+    { "small-hot", 4, 32, 90 },
+    { "large-uniform", 200, BENCH_MAX_SIZE, 0 },
+};
+
+static ee_flash_t fm;
+static unsigned int randomState = 1;
+static unsigned char values[DATA_NUM][BENCH_MAX_SIZE];
+static int valueSizes[DATA_NUM];
+
+static unsigned int nextRandom(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+
+    return (randomState >> 8) & 0xFFFFFF;
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void mount(void)
+{
+    ee_flashInit(&fm, SECTORS(0), SECTORS(BENCH_INDEX_SECTORS), BENCH_INDEX_SECTORS, 1,
+                 SECTORS(2 * BENCH_INDEX_SECTORS), SECTORS(2 * BENCH_INDEX_SECTORS + BENCH_DATA_SECTORS), BENCH_DATA_SECTORS);
+}
+
+static int runLoad(const benchLoad_t* pload, int writeNum)
+{
+    int i, n;
+    double* latency = malloc(sizeof(double) * writeNum);
+    double readTime = 0, writeTime = 0;
+    unsigned long logicalBytes = 0, minErases = ~0UL, maxErases = 0, totalErases = 0;
+    /* 只在ee_writeDataToFlash()中调用驱动函数的次数 */
+    unsigned long writeCalls = 0, readCalls = 0, eraseCalls = 0;
+    unsigned char buf[BENCH_MAX_SIZE];
+    nor_simStats_t before, after;
+
+    nor_simInit(SECTORS(BENCH_FLASH_SECTORS), 0);
+    memset(valueSizes, 0, sizeof(valueSizes));
+    mount();
+
+    for (n = 0; n < writeNum; n++)
+    {
+        int id = (pload->hotPercent && ((int)(nextRandom() % 100) < pload->hotPercent)) ? (int)(nextRandom() % 2) : (int)(nextRandom() % DATA_NUM);
+        int size = pload->minSize + nextRandom() % (pload->maxSize - pload->minSize + 1);
+
+        for (i = 0; i < size; i++)
+            values[id][i] = (unsigned char)nextRandom();
+        valueSizes[id] = size;
+
+        nor_simGetStats(&before);
+        if (ee_writeDataToFlash(&fm, values[id], (ee_size_t)size, (variableLists)id))
+        {
+            printf("%s: write %d failed\n", pload->name, n);
+            return 1;
+        }
+        nor_simGetStats(&after);
+
+        latency[n] = after.timeUs - before.timeUs;
+        writeCalls += after.writeCount - before.writeCount;
+        readCalls += after.readCount - before.readCount;
+        eraseCalls += after.eraseCount - before.eraseCount;
+        writeTime += latency[n];
+        logicalBytes += size;
+
+        /* 读出刚写入的数据，同时统计读取耗时 */
+        nor_simGetStats(&before);
+        if (ee_readDataFromFlash(&fm, buf, (variableLists)id) || memcmp(buf, values[id], size))
+        {
+            printf("%s: read back %d failed\n", pload->name, n);
+            return 1;
+        }
+        nor_simGetStats(&after);
+
+        readTime += after.timeUs - before.timeUs;
+    }
+
+    nor_simGetStats(&after);
+    qsort(latency, writeNum, sizeof(double), compareDouble);
+
+    for (i = 0; i < BENCH_FLASH_SECTORS; i++)
+    {
+        unsigned long erases = nor_simSectorErases(i);
+
+        if (erases < minErases)
+            minErases = erases;
+        if (erases > maxErases)
+            maxErases = erases;
+        totalErases += erases;
+    }
+
+    printf("%-14s writes=%d throughput=%.1fKB/s write p50=%.2fms p99=%.2fms max=%.2fms read avg=%.3fms\n",
+           pload->name, writeNum, logicalBytes / 1024.0 / (writeTime / 1e6),
+           latency[writeNum / 2] / 1000, latency[writeNum * 99 / 100] / 1000, latency[writeNum - 1] / 1000, readTime / writeNum / 1000);
+    printf("%-14s program ops=%lu (%.2f/write) pages=%lu bytes=%lu read ops=%lu erases=%lu per sector min=%lu max=%lu avg=%.1f\n",
+           "", after.writeCount, (double)after.writeCount / writeNum, after.pageCount, after.writeBytes, after.readCount,
+           after.eraseCount, minErases, maxErases, (double)totalErases / BENCH_FLASH_SECTORS);
+    printf("%-14s driver calls per write: program=%.2f read=%.2f erase=%.3f total=%.2f\n",
+           "", (double)writeCalls / writeNum, (double)readCalls / writeNum, (double)eraseCalls / writeNum,
+           (double)(writeCalls + readCalls + eraseCalls) / writeNum);
+
+    free(latency);
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int writeNum = (argc > 1) ? atoi(argv[1]) : 5000;
+    unsigned int i;
+
+    if (writeNum <= 0)
+        writeNum = 1;
+
+    for (i = 0; i < sizeof(benchLoads) / sizeof(benchLoads[0]); i++)
+    {
+        if (runLoad(&benchLoads[i], writeNum))
+            return 1;
+    }
+
+    nor_simDeinit();
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file cache_test.c
+ * @brief 读缓存测试：读出的数据与写入的值相同，超出范围的id返回1而不是命中空闲的缓存项，
+ *        命中和未命中次数与读取的次数一致
+ * @note  用法: cache_test [写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emulateEEprom.h"
+
+#define CACHE_INDEX_SECTORS 2
+#define CACHE_DATA_SECTORS  4
+#define CACHE_FLASH_SECTORS (2 * CACHE_INDEX_SECTORS + 2 * CACHE_DATA_SECTORS)
+#define CACHE_MAX_SIZE      (2 * EE_READ_CACHE_DATA_SIZE)
+
+static ee_flash_t fm;
+static unsigned int randomState = 1;
+static unsigned char values[DATA_NUM][CACHE_MAX_SIZE];
+static int valueSizes[DATA_NUM];
+
+static unsigned int nextRandom(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+
+    return (randomState >> 8) & 0xFFFFFF;
+}
+
+static void fail(const char* what, int id)
+{
+    printf("FAIL: id %d: %s\n", id, what);
+    exit(1);
+}
+
+static void mount(void)
+{
+    ee_flashInit(&fm, SECTORS(0), SECTORS(CACHE_INDEX_SECTORS), CACHE_INDEX_SECTORS, 1,
+                 SECTORS(2 * CACHE_INDEX_SECTORS), SECTORS(2 * CACHE_INDEX_SECTORS + CACHE_DATA_SECTORS), CACHE_DATA_SECTORS);
+}
+
+/**
+ * @brief: 超出范围的id(包括低16位为0xFFFF的id)在三个读接口中都返回1，不计入统计
+ */
+static void checkOutOfRange(void)
+{
+    static const unsigned int ids[] = {DATA_NUM, 0xFFFF, 0x1FFFF, 0x10000};
+    unsigned char buf[CACHE_MAX_SIZE];
+    ee_size_t size = 0;
+    ee_uint32 hits, misses, hits2, misses2;
+    unsigned int i;
+
+    ee_getCacheStats(&fm, &hits, &misses);
+
+    for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+    {
+        if (ee_readDataFromFlash(&fm, buf, (variableLists)ids[i]) != 1)
+            fail("read of an out-of-range id did not return 1", (int)ids[i]);
+        if (ee_getDataSize(&fm, (variableLists)ids[i], &size) != 1)
+            fail("size of an out-of-range id did not return 1", (int)ids[i]);
+        if (ee_readDataRange(&fm, buf, (variableLists)ids[i], 0, 1) != 1)
+            fail("range read of an out-of-range id did not return 1", (int)ids[i]);
+    }
+
+    ee_getCacheStats(&fm, &hits2, &misses2);
+    if ((hits2 != hits) || (misses2 != misses))
+        fail("out-of-range reads changed the cache statistics", -1);
+}
+
+int main(int argc, char** argv)
+{
+    int n, i, id, writeNum = (argc > 1) ? atoi(argv[1]) : 2000;
+    unsigned long reads = 0, sizeQueries = 0;
+    unsigned char buf[CACHE_MAX_SIZE];
+    ee_uint32 hits, misses, hits2, misses2;
+    ee_size_t size;
+
+    nor_simInit(SECTORS(CACHE_FLASH_SECTORS), 0);
+    mount();
+
+    /* 缓存中都是空闲项时 */
+    checkOutOfRange();
+
+    for (n = 0; n < writeNum; n++)
+    {
+        int newSize = 1 + nextRandom() % CACHE_MAX_SIZE;
+
+        id = nextRandom() % DATA_NUM;
+        for (i = 0; i < newSize; i++)
+            values[id][i] = (unsigned char)nextRandom();
+        valueSizes[id] = newSize;
+
+        if (ee_writeDataToFlash(&fm, values[id], (ee_size_t)newSize, (variableLists)id))
+            fail("write failed", id);
+
+        id = nextRandom() % DATA_NUM;
+        if (valueSizes[id] == 0)
+            continue;
+
+        ee_getCacheStats(&fm, &hits, &misses);
+        if (ee_readDataFromFlash(&fm, buf, (variableLists)id) || memcmp(buf, values[id], valueSizes[id]))
+            fail("wrong value", id);
+        ee_getCacheStats(&fm, &hits2, &misses2);
+        reads++;
+
+        /* 一次读取是一次命中或者一次未命中 */
+        if ((hits2 - hits) + (misses2 - misses) != 1)
+            fail("a read was not counted exactly once", id);
+
+        /* 大小查询不会把数据放入缓存，只统计命中 */
+        if (ee_getDataSize(&fm, (variableLists)id, &size) || (size != (ee_size_t)valueSizes[id]))
+            fail("wrong size", id);
+        ee_getCacheStats(&fm, &hits, &misses);
+        if ((misses != misses2) || (hits - hits2 > 1))
+            fail("a size query was counted as a miss", id);
+        sizeQueries++;
+    }
+
+    checkOutOfRange();
+
+    ee_getCacheStats(&fm, &hits, &misses);
+    printf("cache: writes=%d reads=%lu size queries=%lu hits=%u misses=%u\n",
+           writeNum, reads, sizeQueries, (unsigned int)hits, (unsigned int)misses);
+
+    nor_simDeinit();
+
+    return 0;
+}
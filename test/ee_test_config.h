@@ -0,0 +1,41 @@
+/**
+ * @file ee_test_config.h
+ * @brief PC上测试使用的配置文件，通过-DEE_CONFIG_FILE=\"ee_test_config.h\"引入
+ * @note  可选功能在编译命令中用-D开启，例如-DEE_USE_INDEX_TABLE=1
+ */
+
+#ifndef __EE_TEST_CONFIG_H_
+#define __EE_TEST_CONFIG_H_
+
+#include "nor_sim.h"
+
+#define SECTOR_SIZE      NOR_SIM_SECTOR_SIZE
+#define BLOCk_SECTOR_NUM 16
+#define FLASH_PAGE_SIZE  NOR_SIM_PAGE_SIZE
+
+/* 测试程序需要在驱动函数外面加一层时(例如加锁、在线程中擦除)，用-DEE_TEST_DRIVER_FILE=\"xxx.h\"指定填写驱动函数名的头文件 */
+#ifdef EE_TEST_DRIVER_FILE
+#include EE_TEST_DRIVER_FILE
+#else
+#define ee_flashWrite        nor_simWrite
+#define ee_flashRead         nor_simRead
+#define ee_flashEraseASector nor_simEraseSector
+
+#define ee_flashEraseASectorStart nor_simEraseSectorStart
+#define ee_flashIsBusy            nor_simIsBusy
+#endif
+
+/* 测试使用的数据个数 */
+#ifndef EE_TEST_DATA_NUM
+#define EE_TEST_DATA_NUM 8
+#endif
+
+#define EE_USER_VARIABLE_LISTS
+typedef enum
+{
+    TEST_DATA0,
+
+    DATA_NUM = EE_TEST_DATA_NUM,
+} variableLists;
+
+#endif /* __EE_TEST_CONFIG_H_ */
@@ -0,0 +1,202 @@
+/**
+ * @file instance_test.c
+ * @brief 多实例测试：两个实例放在同一块模拟flash的不同区域，两个线程不加锁同时各自写入一个实例
+ * @note  每次写入后读出检查，实例之间不能互相影响(工作缓冲区属于各自的ee_flash_t)；
+ *        驱动函数用一把锁串行执行(见thread_driver.c)，最后输出同时调用的次数
+ *        用法: instance_test [每个线程的写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "flash_emulateEEprom.h"
+
+#define INST_INDEX_SECTORS 2
+#define INST_DATA_SECTORS  4
+#define INST_SECTORS       (2 * INST_INDEX_SECTORS + 2 * INST_DATA_SECTORS)
+#define INST_NUM           2
+#define INST_MAX_SIZE      64
+#define INST_BATCH_MAX     4
+
+typedef struct
+{
+    ee_flash_t fm;
+    int index;
+    int writeNum;
+    unsigned int randomState;
+    int sizes[DATA_NUM];
+    unsigned char values[DATA_NUM][INST_MAX_SIZE];
+    const char* error;
+} instance_t;
+
+static ee_flashDriver_t driver = {thread_driverWrite, thread_driverRead, thread_driverEraseSector};
+static instance_t instances[INST_NUM];
+
+static unsigned int nextRandom(instance_t* pinst)
+{
+    pinst->randomState = pinst->randomState * 1103515245 + 12345;
+
+    return (pinst->randomState >> 8) & 0xFFFFFF;
+}
+
+static void mount(instance_t* pinst)
+{
+    ee_uint32 base = SECTORS(INST_SECTORS * pinst->index);
+
+    ee_setInstance(&pinst->fm, &driver, DATA_NUM);
+    ee_flashInit(&pinst->fm, base, base + SECTORS(INST_INDEX_SECTORS), INST_INDEX_SECTORS, 1,
+                 base + SECTORS(2 * INST_INDEX_SECTORS), base + SECTORS(2 * INST_INDEX_SECTORS + INST_DATA_SECTORS), INST_DATA_SECTORS);
+}
+
+/**
+ * @brief: 生成一个新值，一部分与原值相同(不需要重新写入)，一部分大部分字节相同(可以压缩)
+ */
+static int randomValue(instance_t* pinst, int id, unsigned char* buf)
+{
+    int i, size;
+
+    if ((pinst->sizes[id] != 0) && (nextRandom(pinst) % 4 == 0))
+    {
+        memcpy(buf, pinst->values[id], pinst->sizes[id]);
+        return pinst->sizes[id];
+    }
+
+    size = 1 + nextRandom(pinst) % INST_MAX_SIZE;
+
+    for (i = 0; i < size; i++)
+        buf[i] = (unsigned char)nextRandom(pinst);
+
+    if (nextRandom(pinst) % 2 == 0)
+        memset(buf, (unsigned char)(pinst->index + 1), size - size / 4);
+
+    return size;
+}
+
+static int checkAll(instance_t* pinst)
+{
+    unsigned char buf[INST_MAX_SIZE];
+    int id;
+
+    for (id = 0; id < DATA_NUM; id++)
+    {
+        if (pinst->sizes[id] == 0)
+            continue;
+
+        if (ee_readDataFromFlash(&pinst->fm, buf, (variableLists)id) || memcmp(buf, pinst->values[id], pinst->sizes[id]))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void* writerThread(void* arg)
+{
+    instance_t* pinst = arg;
+    unsigned char buf[INST_BATCH_MAX][INST_MAX_SIZE];
+    int n;
+
+    for (n = 0; (n < pinst->writeNum) && (pinst->error == 0); n++)
+    {
+#if EE_USE_BATCH_WRITE
+        if (nextRandom(pinst) % 4 == 0)
+        {
+            ee_batchItem_t items[INST_BATCH_MAX];
+            int i, itemNum = 1 + nextRandom(pinst) % INST_BATCH_MAX;
+
+            for (i = 0; i < itemNum; i++)
+            {
+                items[i].dataId = (variableLists)(nextRandom(pinst) % DATA_NUM);
+                items[i].buf = buf[i];
+                items[i].bufSize = (ee_size_t)randomValue(pinst, items[i].dataId, buf[i]);
+            }
+
+            if (ee_writeBatchToFlash(&pinst->fm, items, (ee_uint16)itemNum))
+            {
+                pinst->error = "batch write failed";
+                break;
+            }
+
+            for (i = 0; i < itemNum; i++)
+            {
+                memcpy(pinst->values[items[i].dataId], buf[i], items[i].bufSize);
+                pinst->sizes[items[i].dataId] = items[i].bufSize;
+            }
+        }
+        else
+#endif
+        {
+            int id = nextRandom(pinst) % DATA_NUM;
+            int size = randomValue(pinst, id, buf[0]);
+
+            if (ee_writeDataToFlash(&pinst->fm, buf[0], (ee_size_t)size, (variableLists)id))
+            {
+                pinst->error = "write failed";
+                break;
+            }
+
+            memcpy(pinst->values[id], buf[0], size);
+            pinst->sizes[id] = size;
+        }
+
+        if (checkAll(pinst))
+            pinst->error = "read back a wrong value";
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int i, writeNum = (argc > 1) ? atoi(argv[1]) : 5000;
+    pthread_t threads[INST_NUM];
+    thread_driverStats_t stats;
+    int failed = 0;
+
+    nor_simInit(SECTORS(INST_NUM * INST_SECTORS), 0);
+    thread_driverStart(0);
+
+    memset(instances, 0, sizeof(instances));
+    for (i = 0; i < INST_NUM; i++)
+    {
+        instances[i].index = i;
+        instances[i].writeNum = writeNum;
+        instances[i].randomState = (unsigned int)i + 1;
+        mount(&instances[i]);
+    }
+
+    for (i = 0; i < INST_NUM; i++)
+        pthread_create(&threads[i], 0, writerThread, &instances[i]);
+
+    for (i = 0; i < INST_NUM; i++)
+    {
+        pthread_join(threads[i], 0);
+
+        if (instances[i].error != 0)
+        {
+            printf("FAIL: instance %d: %s\n", i, instances[i].error);
+            failed = 1;
+        }
+    }
+
+    /* 重新挂载后两个实例的数据都不变 */
+    for (i = 0; !failed && (i < INST_NUM); i++)
+    {
+        mount(&instances[i]);
+        if (checkAll(&instances[i]))
+        {
+            printf("FAIL: instance %d: wrong value after remount\n", i);
+            failed = 1;
+        }
+    }
+
+    thread_driverStop();
+    thread_driverGetStats(&stats);
+
+    printf("instance: instances=%d writes=%d per instance concurrent driver calls=%lu\n",
+           INST_NUM, writeNum, stats.overlaps);
+
+    nor_simDeinit();
+
+    return failed;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file lock_test.c
+ * @brief 多线程测试：一个写线程不停写入(期间会多次交换区域)，几个读线程同时不加锁读取
+ * @note  每个数据中带有id、版本号和校验，读线程检查读出的数据是完整的某一个版本，并且版本号不会变小；
+ *        读线程和写线程会同时调用驱动函数，驱动中用一把锁串行执行(见thread_driver.c)，最后输出同时调用的次数
+ *        用法: lock_test [写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "flash_emulateEEprom.h"
+
+#define LOCK_INDEX_SECTORS 2
+#define LOCK_DATA_SECTORS  4
+#define LOCK_FLASH_SECTORS (2 * LOCK_INDEX_SECTORS + 2 * LOCK_DATA_SECTORS)
+#define LOCK_READERS       3
+#define LOCK_HEADER_SIZE   9
+#define LOCK_MAX_SIZE      64
+
+static ee_flash_t fm;
+static volatile int writerDone = 0;
+static unsigned long versions[DATA_NUM];
+
+typedef struct
+{
+    int index;
+    unsigned long reads;
+    double maxReadUs;
+    const char* error;
+} reader_t;
+
+static double nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static unsigned int nextRandom(unsigned int* pstate)
+{
+    *pstate = *pstate * 1103515245 + 12345;
+
+    return (*pstate >> 8) & 0xFFFFFF;
+}
+
+/**
+ * @brief: 由id和版本号生成数据：id、版本号、大小、内容和校验
+ */
+static int makeValue(unsigned char* buf, int id, unsigned long version)
+{
+    unsigned int state = (unsigned int)(id * 131 + version);
+    int i, size = LOCK_HEADER_SIZE + nextRandom(&state) % (LOCK_MAX_SIZE - LOCK_HEADER_SIZE);
+    unsigned char sum = 0;
+
+    buf[0] = (unsigned char)id;
+    memcpy(buf + 1, &version, 4);
+    buf[5] = (unsigned char)size;
+
+    for (i = 6; i < size - 1; i++)
+        buf[i] = (unsigned char)nextRandom(&state);
+
+    for (i = 0; i < size - 1; i++)
+        sum += buf[i];
+    buf[size - 1] = sum;
+
+    return size;
+}
+
+static void* readerThread(void* arg)
+{
+    reader_t* preader = arg;
+    unsigned int state = 7 + preader->index;
+    unsigned long lastVersions[DATA_NUM];
+    unsigned char buf[LOCK_MAX_SIZE], expect[LOCK_MAX_SIZE];
+
+    memset(lastVersions, 0, sizeof(lastVersions));
+
+    while (!writerDone && (preader->error == 0))
+    {
+        int id = nextRandom(&state) % DATA_NUM;
+        unsigned long version = 0;
+        double start = nowUs();
+        ee_uint8 ret = ee_readDataFromFlash(&fm, buf, (variableLists)id);
+        double readUs = nowUs() - start;
+
+        preader->reads++;
+        if (readUs > preader->maxReadUs)
+            preader->maxReadUs = readUs;
+
+        /* 还没有写入过 */
+        if (ret == 2)
+            continue;
+
+        if (ret != 0)
+        {
+            preader->error = "read failed";
+            break;
+        }
+
+        memcpy(&version, buf + 1, 4);
+
+        if ((buf[0] != id) || (makeValue(expect, id, version) != buf[5]) || memcmp(buf, expect, buf[5]))
+            preader->error = "read a torn or wrong value";
+        else if (version < lastVersions[id])
+            preader->error = "version went backwards";
+
+        lastVersions[id] = version;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int i, n, writeNum = (argc > 1) ? atoi(argv[1]) : 20000;
+    unsigned int state = 1;
+    unsigned char buf[LOCK_MAX_SIZE];
+    pthread_t threads[LOCK_READERS];
+    reader_t readers[LOCK_READERS];
+    thread_driverStats_t stats;
+    unsigned long reads = 0;
+    double maxReadUs = 0;
+    int failed = 0;
+
+    nor_simInit(SECTORS(LOCK_FLASH_SECTORS), 0);
+    /* 模拟flash没有延时，只检查并发访问是否正确 */
+    thread_driverStart(0);
+    ee_flashInit(&fm, SECTORS(0), SECTORS(LOCK_INDEX_SECTORS), LOCK_INDEX_SECTORS, 1,
+                 SECTORS(2 * LOCK_INDEX_SECTORS), SECTORS(2 * LOCK_INDEX_SECTORS + LOCK_DATA_SECTORS), LOCK_DATA_SECTORS);
+
+    memset(readers, 0, sizeof(readers));
+    for (i = 0; i < LOCK_READERS; i++)
+    {
+        readers[i].index = i;
+        pthread_create(&threads[i], 0, readerThread, &readers[i]);
+    }
+
+    for (n = 0; n < writeNum; n++)
+    {
+        int id = nextRandom(&state) % DATA_NUM;
+        int size = makeValue(buf, id, ++versions[id]);
+
+        if (ee_writeDataToFlash(&fm, buf, (ee_size_t)size, (variableLists)id))
+        {
+            printf("FAIL: write %d\n", n);
+            failed = 1;
+            break;
+        }
+
+#if EE_USE_INCREMENTAL_GC
+        ee_gcStep(&fm, 1);
+#endif
+    }
+
+    writerDone = 1;
+
+    for (i = 0; i < LOCK_READERS; i++)
+    {
+        pthread_join(threads[i], 0);
+
+        if (readers[i].error != 0)
+        {
+            printf("FAIL: reader %d: %s\n", i, readers[i].error);
+            failed = 1;
+        }
+
+        reads += readers[i].reads;
+        if (readers[i].maxReadUs > maxReadUs)
+            maxReadUs = readers[i].maxReadUs;
+    }
+
+    thread_driverStop();
+    thread_driverGetStats(&stats);
+
+    printf("lock: writes=%d readers=%d reads=%lu max read=%.0fus concurrent driver calls=%lu\n",
+           writeNum, LOCK_READERS, reads, maxReadUs, stats.overlaps);
+
+    nor_simDeinit();
+
+    return failed;
+}
@@ -0,0 +1,276 @@
+/**
+ * @file nor_sim.c
+ * @brief 在PC上用RAM模拟nor flash，用于测试和性能评估
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "nor_sim.h"
+
+/* 异步擦除时查询一次忙状态的耗时(单位:us) */
+#define NOR_SIM_POLL_US 50
+
+jmp_buf nor_simCutJmp;
+
+static unsigned char* simMem = 0;
+static unsigned int simSize = 0;
+static int simMapped = 0;
+
+static nor_simTiming_t simTiming = { 10, 700, 0.02, 45000 };
+static nor_simStats_t simStats;
+static unsigned long simSectorErases[NOR_SIM_MAX_SECTORS];
+static unsigned long simProgramOps = 0;
+static unsigned long simCutAt = 0;
+static unsigned int simRandom = 1;
+
+/* 异步擦除的扇区地址和完成时间，没有进行中的擦除时地址为-1 */
+static long simAsyncAddr = -1;
+static double simAsyncDone = 0;
+
+static void simFail(const char* what, unsigned int flashAddr, unsigned int num)
+{
+    fprintf(stderr, "nor_sim: %s (addr 0x%x, num %u)\n", what, flashAddr, num);
+    abort();
+}
+
+static unsigned int simNextRandom(void)
+{
+    simRandom ^= simRandom << 13;
+    simRandom ^= simRandom >> 17;
+    simRandom ^= simRandom << 5;
+
+    return simRandom;
+}
+
+static void simCheckAccess(unsigned int flashAddr, unsigned int num)
+{
+    if ((simMem == 0) || (flashAddr >= simSize) || (num > simSize - flashAddr))
+        simFail("access out of range", flashAddr, num);
+
+    if (simAsyncAddr >= 0)
+        simFail("access while erase is in progress", flashAddr, num);
+}
+
+/**
+ * @brief: 写或擦除操作计数，到达断电位置时返回1
+ */
+static int simCountProgram(void)
+{
+    simProgramOps++;
+
+    if ((simCutAt != 0) && (simProgramOps >= simCutAt))
+    {
+        simCutAt = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+void nor_simInit(unsigned int size, const char* path)
+{
+    nor_simDeinit();
+
+    if (path != 0)
+    {
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+        if ((fd < 0) || (ftruncate(fd, size) != 0))
+            simFail("cannot create image file", 0, size);
+
+        simMem = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (simMem == MAP_FAILED)
+            simFail("cannot map image file", 0, size);
+
+        simMapped = 1;
+    }
+    else
+    {
+        simMem = malloc(size);
+        simMapped = 0;
+    }
+
+    simSize = size;
+    memset(simMem, 0xFF, size);
+    memset(simSectorErases, 0, sizeof(simSectorErases));
+    nor_simClearStats();
+    simProgramOps = 0;
+    simCutAt = 0;
+    simAsyncAddr = -1;
+}
+
+void nor_simDeinit(void)
+{
+    if (simMem == 0)
+        return;
+
+    if (simMapped)
+        munmap(simMem, simSize);
+    else
+        free(simMem);
+
+    simMem = 0;
+    simSize = 0;
+}
+
+unsigned char* nor_simMemory(void)
+{
+    return simMem;
+}
+
+unsigned int nor_simSize(void)
+{
+    return simSize;
+}
+
+void nor_simWrite(unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    unsigned int i;
+    unsigned int programNum = num;
+    int cut;
+
+    simCheckAccess(flashAddr, num);
+
+    simStats.writeCount++;
+    simStats.writeBytes += num;
+    simStats.pageCount += (flashAddr % NOR_SIM_PAGE_SIZE + num + NOR_SIM_PAGE_SIZE - 1) / NOR_SIM_PAGE_SIZE;
+    simStats.timeUs += simTiming.cmdUs + simTiming.pageProgramUs * ((flashAddr % NOR_SIM_PAGE_SIZE + num + NOR_SIM_PAGE_SIZE - 1) / NOR_SIM_PAGE_SIZE);
+
+    /* 断电时只有前面随机个字节写完 */
+    cut = simCountProgram();
+    if (cut)
+        programNum = (num != 0) ? simNextRandom() % num : 0;
+
+    for (i = 0; i < programNum; i++)
+        simMem[flashAddr + i] &= buf[i];
+
+    if (cut)
+    {
+        /* 正在编程的字节只有一部分位变成了0 */
+        if (programNum < num)
+            simMem[flashAddr + programNum] &= (unsigned char)(buf[programNum] | simNextRandom());
+
+        longjmp(nor_simCutJmp, 1);
+    }
+}
+
+void nor_simRead(unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    simCheckAccess(flashAddr, num);
+
+    simStats.readCount++;
+    simStats.readBytes += num;
+    simStats.timeUs += simTiming.cmdUs + simTiming.readByteUs * num;
+
+    memcpy(buf, simMem + flashAddr, num);
+}
+
+void nor_simEraseSector(unsigned int flashAddr)
+{
+    unsigned int sectorAddr = flashAddr - flashAddr % NOR_SIM_SECTOR_SIZE;
+
+    simCheckAccess(sectorAddr, NOR_SIM_SECTOR_SIZE);
+
+    simStats.eraseCount++;
+    simStats.timeUs += simTiming.cmdUs + simTiming.sectorEraseUs;
+    if (sectorAddr / NOR_SIM_SECTOR_SIZE < NOR_SIM_MAX_SECTORS)
+        simSectorErases[sectorAddr / NOR_SIM_SECTOR_SIZE]++;
+
+    /* 断电时只擦除了扇区的前一半 */
+    if (simCountProgram())
+    {
+        memset(simMem + sectorAddr, 0xFF, NOR_SIM_SECTOR_SIZE / 2);
+        longjmp(nor_simCutJmp, 1);
+    }
+
+    memset(simMem + sectorAddr, 0xFF, NOR_SIM_SECTOR_SIZE);
+}
+
+void nor_simEraseSectorStart(unsigned int flashAddr)
+{
+    unsigned int sectorAddr = flashAddr - flashAddr % NOR_SIM_SECTOR_SIZE;
+
+    simCheckAccess(sectorAddr, NOR_SIM_SECTOR_SIZE);
+
+    simStats.eraseCount++;
+    simStats.timeUs += simTiming.cmdUs;
+    if (sectorAddr / NOR_SIM_SECTOR_SIZE < NOR_SIM_MAX_SECTORS)
+        simSectorErases[sectorAddr / NOR_SIM_SECTOR_SIZE]++;
+
+    if (simCountProgram())
+    {
+        memset(simMem + sectorAddr, 0xFF, NOR_SIM_SECTOR_SIZE / 2);
+        longjmp(nor_simCutJmp, 1);
+    }
+
+    simAsyncAddr = sectorAddr;
+    simAsyncDone = simStats.timeUs + simTiming.sectorEraseUs;
+}
+
+unsigned char nor_simIsBusy(void)
+{
+    if (simAsyncAddr < 0)
+        return 0;
+
+    simStats.timeUs += NOR_SIM_POLL_US;
+
+    if (simStats.timeUs < simAsyncDone)
+        return 1;
+
+    memset(simMem + simAsyncAddr, 0xFF, NOR_SIM_SECTOR_SIZE);
+    simAsyncAddr = -1;
+
+    return 0;
+}
+
+void nor_simSetTiming(nor_simTiming_t* ptiming)
+{
+    nor_simTiming_t defaultTiming = { 10, 700, 0.02, 45000 };
+
+    simTiming = (ptiming != 0) ? *ptiming : defaultTiming;
+}
+
+void nor_simSetCut(unsigned long n)
+{
+    simCutAt = (n != 0) ? simProgramOps + n : 0;
+    simRandom = (unsigned int)(simProgramOps * 2654435761u) | 1;
+}
+
+unsigned long nor_simProgramOps(void)
+{
+    return simProgramOps;
+}
+
+void nor_simGetStats(nor_simStats_t* pstats)
+{
+    *pstats = simStats;
+}
+
+void nor_simClearStats(void)
+{
+    memset(&simStats, 0, sizeof(simStats));
+}
+
+unsigned long nor_simSectorErases(unsigned int sector)
+{
+    return (sector < NOR_SIM_MAX_SECTORS) ? simSectorErases[sector] : 0;
+}
+
+void nor_simSave(unsigned char* image)
+{
+    memcpy(image, simMem, simSize);
+}
+
+void nor_simRestore(unsigned char* image)
+{
+    memcpy(simMem, image, simSize);
+
+    /* 恢复镜像时没有进行中的擦除 */
+    simAsyncAddr = -1;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file nor_sim.h
+ * @brief 在PC上用RAM模拟nor flash，用于测试和性能评估
+ * @note  写操作只能把1变成0(新值与原值按位与)，擦除把整个扇区变成0xFF
+ *        对每次操作计数并按延时模型累计耗时，可以在第N次写或擦除时模拟断电
+ */
+
+#ifndef __NOR_SIM_H_
+#define __NOR_SIM_H_
+
+#include <setjmp.h>
+
+/* 模拟flash的扇区大小和页大小(与测试配置中的SECTOR_SIZE、FLASH_PAGE_SIZE相同) */
+#define NOR_SIM_SECTOR_SIZE  4096
+#define NOR_SIM_PAGE_SIZE    256
+/* 统计擦除次数的最大扇区个数 */
+#define NOR_SIM_MAX_SECTORS  256
+
+/* 延时模型(单位:us) */
+typedef struct
+{
+    /* 每条命令的固定开销(写使能、命令和地址) */
+    double cmdUs;
+    /* 编程一页 */
+    double pageProgramUs;
+    /* 读出一个字节 */
+    double readByteUs;
+    /* 擦除一个扇区 */
+    double sectorEraseUs;
+} nor_simTiming_t;
+
+/* 操作统计 */
+typedef struct
+{
+    unsigned long readCount;
+    unsigned long readBytes;
+    unsigned long writeCount;
+    unsigned long writeBytes;
+    /* 写操作编程的页数(跨页的写入按多页计算) */
+    unsigned long pageCount;
+    unsigned long eraseCount;
+    /* 按延时模型累计的耗时 */
+    double timeUs;
+} nor_simStats_t;
+
+/* 断电后跳转的位置，调用nor_simSetCut()前先setjmp */
+extern jmp_buf nor_simCutJmp;
+
+/**
+ * @brief      创建一块全为0xFF的模拟flash
+ *
+ * @param size 大小(单位:byte)，必须是扇区大小的整数倍
+ * @param path 为NULL时在RAM中分配，否则把这个文件映射为flash镜像(可以通过nor_simMemory()直接访问)
+ */
+void nor_simInit(unsigned int size, const char* path);
+
+/**
+ * @brief 释放模拟flash
+ */
+void nor_simDeinit(void);
+
+/**
+ * @brief  返回模拟flash的存储空间，flash地址0对应返回的地址
+ */
+unsigned char* nor_simMemory(void);
+
+/**
+ * @brief  返回模拟flash的大小
+ */
+unsigned int nor_simSize(void);
+
+/* 驱动函数，原型与flash_emulateEEprom.h中的驱动函数相同 */
+void nor_simWrite(unsigned int flashAddr, unsigned char* buf, unsigned short num);
+void nor_simRead(unsigned int flashAddr, unsigned char* buf, unsigned short num);
+void nor_simEraseSector(unsigned int flashAddr);
+
+/* 异步擦除：启动后按延时模型经过sectorEraseUs才完成，期间的读写操作会报错退出 */
+void nor_simEraseSectorStart(unsigned int flashAddr);
+unsigned char nor_simIsBusy(void);
+
+/**
+ * @brief        设置延时模型，为NULL时恢复默认值(编程一页0.7ms，擦除一个扇区45ms)
+ */
+void nor_simSetTiming(nor_simTiming_t* ptiming);
+
+/**
+ * @brief        模拟在之后第n次写或擦除操作中断电：写操作只完成前面随机个字节，下一个字节只有部分位被编程，
+ *               擦除操作只擦除扇区的前一半，然后longjmp到nor_simCutJmp，n为0时取消
+ */
+void nor_simSetCut(unsigned long n);
+
+/**
+ * @brief  返回从创建模拟flash开始的写和擦除操作次数，用于确定断电位置
+ */
+unsigned long nor_simProgramOps(void);
+
+void nor_simGetStats(nor_simStats_t* pstats);
+void nor_simClearStats(void);
+
+/**
+ * @brief  返回一个扇区的擦除次数
+ */
+unsigned long nor_simSectorErases(unsigned int sector);
+
+/**
+ * @brief  保存和恢复flash镜像(断电测试中先完整运行一遍得到操作次数)
+ */
+void nor_simSave(unsigned char* image);
+void nor_simRestore(unsigned char* image);
+
+#endif /* __NOR_SIM_H_ */
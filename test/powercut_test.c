@@ -0,0 +1,375 @@
+/**
+ * @file powercut_test.c
+ * @brief 掉电测试：在每次写入(以及批量写入、回收)中随机选择一个写或擦除操作断电，重新挂载后检查每个数据读出的都是写入前或写入后的值
+ * @note  断电的操作只完成一部分(写入前面随机个字节且下一个字节只编程部分位，或者擦除半个扇区)，
+ *        挂载也可能再次断电。最后输出所有断电位置中挂载的最大读、写、擦除次数
+ *        用法: powercut_test [随机种子个数] [每个种子的写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emulateEEprom.h"
+
+#define CUT_INDEX_SECTORS 2
+#define CUT_DATA_SECTORS  4
+#define CUT_FLASH_SECTORS (2 * CUT_INDEX_SECTORS + 2 * CUT_DATA_SECTORS)
+#define CUT_MAX_SIZE      40
+#define CUT_BATCH_MAX     5
+
+typedef struct
+{
+    /* -1表示没有写入过 */
+    int size;
+    unsigned char data[CUT_MAX_SIZE];
+} value_t;
+
+static ee_flash_t fm;
+static value_t model[DATA_NUM];
+static unsigned char image[SECTORS(CUT_FLASH_SECTORS)];
+static unsigned int randomState;
+static int seed, step;
+static unsigned long cutNum, mountCutNum;
+static nor_simStats_t worstMount;
+
+static unsigned int nextRandom(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+
+    return (randomState >> 8) & 0xFFFFFF;
+}
+
+static void fail(const char* what, int id)
+{
+    printf("FAIL seed %d step %d id %d: %s\n", seed, step, id, what);
+    exit(1);
+}
+
+static void mount(void)
+{
+    ee_flashInit(&fm, SECTORS(0), SECTORS(CUT_INDEX_SECTORS), CUT_INDEX_SECTORS, 1,
+                 SECTORS(2 * CUT_INDEX_SECTORS), SECTORS(2 * CUT_INDEX_SECTORS + CUT_DATA_SECTORS), CUT_DATA_SECTORS);
+}
+
+/**
+ * @brief: 挂载并记录挂载的开销
+ */
+static void measuredMount(void)
+{
+    nor_simStats_t stats;
+
+    nor_simClearStats();
+    mount();
+    nor_simGetStats(&stats);
+
+    if (stats.timeUs > worstMount.timeUs)
+        worstMount = stats;
+}
+
+static void randomValue(value_t* pvalue)
+{
+    int i;
+
+    pvalue->size = 1 + nextRandom() % CUT_MAX_SIZE;
+
+    for (i = 0; i < pvalue->size; i++)
+        pvalue->data[i] = (unsigned char)nextRandom();
+
+    /* 一部分数据大部分是0或0xFF，压缩和查空都会遇到 */
+    if (nextRandom() % 4 == 0)
+        memset(pvalue->data, (nextRandom() & 1) ? 0x00 : 0xFF, pvalue->size - pvalue->size / 4);
+}
+
+/**
+ * @brief: 数据id的内容是否与pvalue相同
+ */
+static int matches(int id, value_t* pvalue)
+{
+    unsigned char buf[CUT_MAX_SIZE + 8];
+    ee_size_t size = 0;
+    ee_uint8 ret;
+
+    memset(buf, 0xA5, sizeof(buf));
+    ret = ee_readDataFromFlash(&fm, buf, (variableLists)id);
+
+    if (pvalue->size < 0)
+        return ret != 0;
+
+    if ((ret != 0) || ee_getDataSize(&fm, (variableLists)id, &size) || (size != (ee_size_t)pvalue->size))
+        return 0;
+
+    return (memcmp(buf, pvalue->data, pvalue->size) == 0) && (buf[pvalue->size] == 0xA5);
+}
+
+/**
+ * @brief: 检查所有数据与模型相同，changed中的id也可以是newValues中的新值(此时更新模型)
+ */
+static void verify(const char* where, int changed, value_t* newValue)
+{
+    int id;
+
+    for (id = 0; id < DATA_NUM; id++)
+    {
+        if (matches(id, &model[id]))
+            continue;
+
+        if ((id == changed) && matches(id, newValue))
+        {
+            model[id] = *newValue;
+            continue;
+        }
+
+        fail(where, id);
+    }
+}
+
+/* 被测试的一次操作 */
+typedef struct
+{
+    int kind;
+    int id;
+    value_t value;
+#if EE_USE_BATCH_WRITE
+    int itemNum;
+    int ids[CUT_BATCH_MAX];
+    value_t values[CUT_BATCH_MAX];
+#endif
+#if EE_USE_INCREMENTAL_GC
+    int budget;
+#endif
+} operation_t;
+
+#define OP_WRITE 0
+#define OP_BATCH 1
+#define OP_GC    2
+
+static int runOperation(operation_t* pop)
+{
+#if EE_USE_BATCH_WRITE
+    ee_batchItem_t items[CUT_BATCH_MAX];
+    int i;
+#endif
+
+    switch (pop->kind)
+    {
+#if EE_USE_BATCH_WRITE
+        case OP_BATCH:
+            for (i = 0; i < pop->itemNum; i++)
+            {
+                items[i].dataId = (variableLists)pop->ids[i];
+                items[i].buf = pop->values[i].data;
+                items[i].bufSize = (ee_size_t)pop->values[i].size;
+            }
+            return ee_writeBatchToFlash(&fm, items, (ee_uint16)pop->itemNum);
+#endif
+#if EE_USE_INCREMENTAL_GC
+        case OP_GC:
+            ee_gcStep(&fm, (ee_uint16)pop->budget);
+            return 0;
+#endif
+        default:
+            return ee_writeDataToFlash(&fm, pop->value.data, (ee_size_t)pop->value.size, (variableLists)pop->id);
+    }
+}
+
+static void randomOperation(operation_t* pop)
+{
+    pop->kind = OP_WRITE;
+    pop->id = nextRandom() % DATA_NUM;
+    randomValue(&pop->value);
+
+#if EE_USE_BATCH_WRITE
+    if (nextRandom() % 3 == 0)
+    {
+        int i;
+
+        pop->kind = OP_BATCH;
+        pop->itemNum = 1 + nextRandom() % CUT_BATCH_MAX;
+
+        for (i = 0; i < pop->itemNum; i++)
+        {
+            pop->ids[i] = nextRandom() % DATA_NUM;
+            randomValue(&pop->values[i]);
+        }
+    }
+#endif
+
+#if EE_USE_INCREMENTAL_GC
+    if (nextRandom() % 3 == 0)
+    {
+        pop->kind = OP_GC;
+        pop->budget = 1 + nextRandom() % 4;
+    }
+#endif
+}
+
+/**
+ * @brief: 操作完成后更新模型
+ */
+static void applyOperation(operation_t* pop, value_t* pmodel)
+{
+#if EE_USE_BATCH_WRITE
+    int i;
+
+    if (pop->kind == OP_BATCH)
+    {
+        for (i = 0; i < pop->itemNum; i++)
+            pmodel[pop->ids[i]] = pop->values[i];
+        return;
+    }
+#endif
+
+    if (pop->kind == OP_WRITE)
+        pmodel[pop->id] = pop->value;
+}
+
+/**
+ * @brief: 断电后检查，批量写入要么全部生效要么全部不生效
+ */
+static void verifyAfterCut(operation_t* pop)
+{
+#if EE_USE_BATCH_WRITE
+    if (pop->kind == OP_BATCH)
+    {
+        static value_t newModel[DATA_NUM];
+        int id, isOld = 1, isNew = 1;
+
+        memcpy(newModel, model, sizeof(model));
+        applyOperation(pop, newModel);
+
+        for (id = 0; id < DATA_NUM; id++)
+        {
+            if (!matches(id, &model[id]))
+                isOld = 0;
+            if (!matches(id, &newModel[id]))
+                isNew = 0;
+        }
+
+        if (!isOld && !isNew)
+            fail("batch write is not atomic", -1);
+
+        if (isNew)
+            memcpy(model, newModel, sizeof(model));
+        return;
+    }
+#endif
+
+    if (pop->kind == OP_WRITE)
+        verify("after power cut", pop->id, &pop->value);
+    else
+        verify("after power cut during gc", -1, 0);
+}
+
+/**
+ * @brief: 在挂载时再次随机断电，然后正常挂载
+ */
+static void remountAfterCut(void)
+{
+    ee_flash_t saved = fm;
+    unsigned long before, cost;
+
+    if (nextRandom() % 4 == 0)
+    {
+        /* 先完整挂载一遍得到挂载中写和擦除的次数 */
+        nor_simSave(image);
+        before = nor_simProgramOps();
+        mount();
+        cost = nor_simProgramOps() - before;
+        nor_simRestore(image);
+        fm = saved;
+
+        if (cost > 0)
+        {
+            nor_simSetCut(1 + nextRandom() % cost);
+            if (setjmp(nor_simCutJmp) == 0)
+            {
+                mount();
+                nor_simSetCut(0);
+            }
+            mountCutNum++;
+        }
+    }
+
+    measuredMount();
+}
+
+static void runSeed(int writeNum)
+{
+    int id;
+
+    randomState = (unsigned int)seed * 7919 + 1;
+    nor_simInit(SECTORS(CUT_FLASH_SECTORS), 0);
+    mount();
+
+    for (id = 0; id < DATA_NUM; id++)
+        model[id].size = -1;
+
+    for (step = 0; step < writeNum; step++)
+    {
+        operation_t op;
+        ee_flash_t saved = fm;
+        unsigned long before, cost;
+        int ret;
+
+        randomOperation(&op);
+
+        /* 先完整运行一遍得到写和擦除的次数，再从同一个flash镜像开始在其中一次操作断电 */
+        nor_simSave(image);
+        before = nor_simProgramOps();
+        ret = runOperation(&op);
+        cost = nor_simProgramOps() - before;
+        nor_simRestore(image);
+        fm = saved;
+
+        if (ret != 0)
+        {
+            /* 空间不足的批量写入什么也不做 */
+            if ((op.kind == OP_BATCH) && (ret == 3))
+                continue;
+            fail("operation failed", op.id);
+        }
+
+        if (cost > 0)
+        {
+            nor_simSetCut(1 + nextRandom() % cost);
+            if (setjmp(nor_simCutJmp) == 0)
+            {
+                runOperation(&op);
+                nor_simSetCut(0);
+                fail("power cut did not happen", op.id);
+            }
+            cutNum++;
+
+            remountAfterCut();
+            verifyAfterCut(&op);
+        }
+
+        /* 断电后再次完整执行，这次必须成功 */
+        if (runOperation(&op) != 0)
+            fail("operation after power cut failed", op.id);
+        applyOperation(&op, model);
+        verify("after operation", -1, 0);
+
+        if (nextRandom() % 50 == 0)
+        {
+            measuredMount();
+            verify("after remount", -1, 0);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int seedNum = (argc > 1) ? atoi(argv[1]) : 10;
+    int writeNum = (argc > 2) ? atoi(argv[2]) : 3000;
+
+    for (seed = 1; seed <= seedNum; seed++)
+        runSeed(writeNum);
+
+    printf("powercut: seeds=%d operations=%d cuts=%lu mount cuts=%lu worst remount reads=%lu writes=%lu erases=%lu (%.1fms)\n",
+           seedNum, writeNum, cutNum, mountCutNum, worstMount.readCount, worstMount.writeCount, worstMount.eraseCount, worstMount.timeUs / 1000);
+
+    nor_simDeinit();
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file stripe_driver.c
+ * @brief EE_USE_STRIPE使用的两片模拟flash
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "stripe_driver.h"
+
+#define STRIPE_OP_NONE  0
+#define STRIPE_OP_WRITE 1
+#define STRIPE_OP_ERASE 2
+
+typedef struct
+{
+    unsigned char* mem;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /* 等待工作线程完成的操作 */
+    int op;
+    unsigned int addr;
+    unsigned char* buf;
+    unsigned short num;
+    volatile int busy;
+} stripe_dev_t;
+
+static stripe_dev_t devs[2];
+static int running = 0;
+static unsigned int devBytes, sectorBytes, pageDelayUs, eraseDelayUs;
+
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static stripe_driverStats_t driverStats;
+
+static void sleepUs(unsigned int us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    nanosleep(&ts, 0);
+}
+
+static double nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void countBusyAccess(unsigned char dev)
+{
+    if (__atomic_load_n(&devs[dev].busy, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&statsMutex);
+        driverStats.busyAccesses++;
+        pthread_mutex_unlock(&statsMutex);
+    }
+}
+
+static void* devWorker(void* arg)
+{
+    stripe_dev_t* pdev = arg;
+    int index = (int)(pdev - devs);
+    unsigned int i;
+
+    pthread_mutex_lock(&pdev->mutex);
+
+    for (;;)
+    {
+        double start;
+
+        while (running && (pdev->op == STRIPE_OP_NONE))
+            pthread_cond_wait(&pdev->cond, &pdev->mutex);
+
+        if (pdev->op == STRIPE_OP_NONE)
+            break;
+
+        pthread_mutex_unlock(&pdev->mutex);
+
+        start = nowUs();
+        if (pdev->op == STRIPE_OP_WRITE)
+        {
+            sleepUs(pageDelayUs);
+
+            /* 写入完成时才从buf中读出数据，只能把1变成0 */
+            for (i = 0; i < pdev->num; i++)
+                pdev->mem[pdev->addr + i] &= pdev->buf[i];
+        }
+        else
+        {
+            sleepUs(eraseDelayUs);
+            memset(pdev->mem + pdev->addr - pdev->addr % sectorBytes, 0xFF, sectorBytes);
+        }
+
+        pthread_mutex_lock(&statsMutex);
+        if (pdev->op == STRIPE_OP_WRITE)
+            driverStats.writes[index]++;
+        else
+            driverStats.erases[index]++;
+        driverStats.busyUs[index] += nowUs() - start;
+        pthread_mutex_unlock(&statsMutex);
+
+        pthread_mutex_lock(&pdev->mutex);
+        pdev->op = STRIPE_OP_NONE;
+        __atomic_store_n(&pdev->busy, 0, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&pdev->mutex);
+
+    return 0;
+}
+
+/**
+ * @brief: 把操作交给一片flash的工作线程
+ */
+static void devStart(unsigned char dev, int op, unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    stripe_dev_t* pdev = &devs[dev];
+
+    countBusyAccess(dev);
+
+    pthread_mutex_lock(&statsMutex);
+    if (__atomic_load_n(&devs[dev ^ 1].busy, __ATOMIC_ACQUIRE))
+        driverStats.overlaps++;
+    pthread_mutex_unlock(&statsMutex);
+
+    pthread_mutex_lock(&pdev->mutex);
+    pdev->op = op;
+    pdev->addr = flashAddr;
+    pdev->buf = buf;
+    pdev->num = num;
+    __atomic_store_n(&pdev->busy, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&pdev->cond);
+    pthread_mutex_unlock(&pdev->mutex);
+}
+
+void stripe_driverStart(unsigned int devSize, unsigned int devSectorSize, unsigned int pageUs, unsigned int eraseUs)
+{
+    int i;
+
+    devBytes = devSize;
+    sectorBytes = devSectorSize;
+    pageDelayUs = pageUs;
+    eraseDelayUs = eraseUs;
+    running = 1;
+    memset(&driverStats, 0, sizeof(driverStats));
+
+    for (i = 0; i < 2; i++)
+    {
+        devs[i].mem = malloc(devBytes);
+        memset(devs[i].mem, 0xFF, devBytes);
+        devs[i].op = STRIPE_OP_NONE;
+        devs[i].busy = 0;
+        pthread_mutex_init(&devs[i].mutex, 0);
+        pthread_cond_init(&devs[i].cond, 0);
+        pthread_create(&devs[i].thread, 0, devWorker, &devs[i]);
+    }
+}
+
+void stripe_driverStop(void)
+{
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        while (stripe_driverIsBusy((unsigned char)i))
+            sleepUs(100);
+
+        pthread_mutex_lock(&devs[i].mutex);
+        running = 0;
+        pthread_cond_signal(&devs[i].cond);
+        pthread_mutex_unlock(&devs[i].mutex);
+
+        pthread_join(devs[i].thread, 0);
+        pthread_mutex_destroy(&devs[i].mutex);
+        pthread_cond_destroy(&devs[i].cond);
+        free(devs[i].mem);
+        devs[i].mem = 0;
+    }
+}
+
+void stripe_driverGetStats(stripe_driverStats_t* pstats)
+{
+    pthread_mutex_lock(&statsMutex);
+    *pstats = driverStats;
+    pthread_mutex_unlock(&statsMutex);
+}
+
+void stripe_driverWriteStart(unsigned char dev, unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    devStart(dev, STRIPE_OP_WRITE, flashAddr, buf, num);
+}
+
+void stripe_driverRead(unsigned char dev, unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    countBusyAccess(dev);
+    memcpy(buf, devs[dev].mem + flashAddr, num);
+}
+
+void stripe_driverEraseStart(unsigned char dev, unsigned int flashAddr)
+{
+    devStart(dev, STRIPE_OP_ERASE, flashAddr, 0, 0);
+}
+
+unsigned char stripe_driverIsBusy(unsigned char dev)
+{
+    return (unsigned char)__atomic_load_n(&devs[dev].busy, __ATOMIC_ACQUIRE);
+}
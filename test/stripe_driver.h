@@ -0,0 +1,53 @@
+/**
+ * @file stripe_driver.h
+ * @brief EE_USE_STRIPE使用的两片模拟flash，每片由一个工作线程完成写入和擦除，经过真实的等待时间后才完成
+ * @note  编译时加上-DEE_TEST_DRIVER_FILE=\"stripe_driver.h\" -DEE_USE_STRIPE=1，库中的条带驱动函数名映射到这里的函数。
+ *        每片flash的扇区大小为SECTOR_SIZE的一半；写入在完成时才从buf中读出数据，库在写完之前修改buf时读出的数据会出错
+ */
+
+#ifndef __STRIPE_DRIVER_H_
+#define __STRIPE_DRIVER_H_
+
+#define ee_stripeWriteStart stripe_driverWriteStart
+#define ee_stripeRead       stripe_driverRead
+#define ee_stripeEraseStart stripe_driverEraseStart
+#define ee_stripeIsBusy     stripe_driverIsBusy
+
+/* 统计 */
+typedef struct
+{
+    /* 每片flash完成的写入和擦除次数 */
+    unsigned long writes[2];
+    unsigned long erases[2];
+    /* 每片flash处于忙状态的总时间(单位:us)，两片相加就是串行执行需要的时间 */
+    double busyUs[2];
+    /* 启动一片flash时另一片正在忙的次数(两片同时工作) */
+    unsigned long overlaps;
+    /* 读或启动写入、擦除时这一片flash还在忙的次数，库应该先等待完成，正确时为0 */
+    unsigned long busyAccesses;
+} stripe_driverStats_t;
+
+/**
+ * @brief         创建两片模拟flash并启动工作线程
+ *
+ * @param devSize       每片flash的大小(单位:字节)
+ * @param devSectorSize 每片flash的扇区大小(SECTOR_SIZE的一半)
+ * @param pageUs        编程一页的等待时间(单位:us)
+ * @param eraseUs       擦除一个扇区的等待时间(单位:us)
+ */
+void stripe_driverStart(unsigned int devSize, unsigned int devSectorSize, unsigned int pageUs, unsigned int eraseUs);
+
+/**
+ * @brief 等待两片flash完成后停止工作线程并释放模拟flash
+ */
+void stripe_driverStop(void);
+
+void stripe_driverGetStats(stripe_driverStats_t* pstats);
+
+/* 驱动函数 */
+void stripe_driverWriteStart(unsigned char dev, unsigned int flashAddr, unsigned char* buf, unsigned short num);
+void stripe_driverRead(unsigned char dev, unsigned int flashAddr, unsigned char* buf, unsigned short num);
+void stripe_driverEraseStart(unsigned char dev, unsigned int flashAddr);
+unsigned char stripe_driverIsBusy(unsigned char dev);
+
+#endif /* __STRIPE_DRIVER_H_ */
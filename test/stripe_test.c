@@ -0,0 +1,145 @@
+/**
+ * @file stripe_test.c
+ * @brief 条带测试：EE_USE_STRIPE把存储区按页交替分布到两片模拟flash上，每片flash由自己的工作线程完成写入和擦除
+ * @note  检查写入、区域交换和重新挂载后读出的数据正确，启动一片flash前它已经完成(驱动统计的忙时访问次数为0)，
+ *        并且两片flash有同时工作的时候。对小数据和较大的数据分别输出两片flash的忙时间和实际耗时：
+ *        两片忙时间之和是按顺序执行需要的时间，实际耗时小于它的部分来自两片flash同时工作
+ *        用法: stripe_test [每种负载的写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_emulateEEprom.h"
+
+#define STRIPE_INDEX_SECTORS 2
+#define STRIPE_DATA_SECTORS  4
+#define STRIPE_FLASH_SECTORS (2 * STRIPE_INDEX_SECTORS + 2 * STRIPE_DATA_SECTORS)
+#define STRIPE_MAX_SIZE      320
+/* 模拟flash编程一页和擦除一个扇区的时间(单位:us)，比真实的flash短，测试可以很快完成 */
+#define STRIPE_PAGE_US       100
+#define STRIPE_ERASE_US      2000
+
+static ee_flash_t fm;
+static unsigned int randomState = 1;
+static unsigned char values[DATA_NUM][STRIPE_MAX_SIZE];
+static int valueSizes[DATA_NUM];
+
+static unsigned int nextRandom(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+
+    return (randomState >> 8) & 0xFFFFFF;
+}
+
+static double nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void mount(void)
+{
+    ee_flashInit(&fm, SECTORS(0), SECTORS(STRIPE_INDEX_SECTORS), STRIPE_INDEX_SECTORS, 1,
+                 SECTORS(2 * STRIPE_INDEX_SECTORS), SECTORS(2 * STRIPE_INDEX_SECTORS + STRIPE_DATA_SECTORS), STRIPE_DATA_SECTORS);
+}
+
+static int verify(void)
+{
+    unsigned char buf[STRIPE_MAX_SIZE];
+    int id;
+
+    for (id = 0; id < DATA_NUM; id++)
+    {
+        if (valueSizes[id] == 0)
+            continue;
+
+        if (ee_readDataFromFlash(&fm, buf, (variableLists)id) || memcmp(buf, values[id], valueSizes[id]))
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief: 写入writeNum个大小在[minSize, maxSize]之间的随机数据
+ */
+static int runWorkload(const char* name, int writeNum, int minSize, int maxSize)
+{
+    int n, i;
+    double start, wallUs;
+    stripe_driverStats_t stats;
+
+    stripe_driverStart(SECTORS(STRIPE_FLASH_SECTORS) / 2, SECTOR_SIZE / 2, STRIPE_PAGE_US, STRIPE_ERASE_US);
+    memset(valueSizes, 0, sizeof(valueSizes));
+    mount();
+
+    start = nowUs();
+    for (n = 0; n < writeNum; n++)
+    {
+        int id = nextRandom() % DATA_NUM;
+        int size = minSize + nextRandom() % (maxSize - minSize + 1);
+
+        for (i = 0; i < size; i++)
+            values[id][i] = (unsigned char)nextRandom();
+        valueSizes[id] = size;
+
+        if (ee_writeDataToFlash(&fm, values[id], (ee_size_t)size, (variableLists)id))
+        {
+            printf("FAIL %s: write %d\n", name, n);
+            return 1;
+        }
+
+        if ((n % 50 == 0) && verify())
+        {
+            printf("FAIL %s: wrong value after write %d\n", name, n);
+            return 1;
+        }
+    }
+    wallUs = nowUs() - start;
+
+    mount();
+    if (verify())
+    {
+        printf("FAIL %s: wrong value after remount\n", name);
+        return 1;
+    }
+
+    stripe_driverStop();
+    stripe_driverGetStats(&stats);
+
+    printf("stripe %-6s writes=%d dev0 writes=%lu erases=%lu busy=%.0fms dev1 writes=%lu erases=%lu busy=%.0fms serial=%.0fms wall=%.0fms overlaps=%lu\n",
+           name, writeNum, stats.writes[0], stats.erases[0], stats.busyUs[0] / 1000, stats.writes[1], stats.erases[1], stats.busyUs[1] / 1000,
+           (stats.busyUs[0] + stats.busyUs[1]) / 1000, wallUs / 1000, stats.overlaps);
+
+    if (stats.busyAccesses != 0)
+    {
+        printf("FAIL %s: a device was accessed before its last operation completed\n", name);
+        return 1;
+    }
+
+    if (stats.overlaps == 0)
+    {
+        printf("FAIL %s: the two devices never worked at the same time\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int writeNum = (argc > 1) ? atoi(argv[1]) : 500;
+
+    if (runWorkload("small", writeNum, 1, 16))
+        return 1;
+
+    if (runWorkload("large", writeNum, 256, STRIPE_MAX_SIZE))
+        return 1;
+
+    return 0;
+}
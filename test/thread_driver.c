@@ -0,0 +1,173 @@
+/**
+ * @file thread_driver.c
+ * @brief 在模拟flash外面加一层用线程实现的驱动函数
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "nor_sim.h"
+#include "thread_driver.h"
+
+static pthread_mutex_t driverMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t writeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t eraseCond = PTHREAD_COND_INITIALIZER;
+static pthread_t eraseThread;
+static int running = 0;
+/* 正在调用驱动函数的线程个数 */
+static int callers = 0;
+static unsigned int eraseDelayUs;
+
+/* 等待工作线程擦除的扇区地址，没有时为-1 */
+static long eraseAddr = -1;
+static volatile int eraseBusy = 0;
+
+static thread_driverStats_t driverStats;
+
+static void sleepUs(unsigned int us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    nanosleep(&ts, 0);
+}
+
+/**
+ * @brief: 进入驱动函数，同一时间只有一个线程访问模拟flash
+ */
+static void driverEnter(int isErase)
+{
+    int overlap = __atomic_fetch_add(&callers, 1, __ATOMIC_ACQ_REL) > 0;
+
+    pthread_mutex_lock(&driverMutex);
+
+    if (overlap)
+        driverStats.overlaps++;
+
+    if (!isErase && eraseBusy)
+        driverStats.busyAccesses++;
+}
+
+static void driverLeave(void)
+{
+    pthread_mutex_unlock(&driverMutex);
+    __atomic_fetch_sub(&callers, 1, __ATOMIC_ACQ_REL);
+}
+
+static void* eraseWorker(void* arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&driverMutex);
+
+    for (;;)
+    {
+        while (running && (eraseAddr < 0))
+            pthread_cond_wait(&eraseCond, &driverMutex);
+
+        if (eraseAddr < 0)
+            break;
+
+        /* 擦除期间不占用锁，其他线程访问flash时可以检查出来 */
+        pthread_mutex_unlock(&driverMutex);
+        sleepUs(eraseDelayUs);
+        pthread_mutex_lock(&driverMutex);
+
+        nor_simEraseSector((unsigned int)eraseAddr);
+        driverStats.asyncErases++;
+        eraseAddr = -1;
+        __atomic_store_n(&eraseBusy, 0, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&driverMutex);
+
+    return 0;
+}
+
+void thread_driverStart(unsigned int eraseUs)
+{
+    eraseDelayUs = eraseUs;
+    eraseAddr = -1;
+    eraseBusy = 0;
+    running = 1;
+
+    pthread_create(&eraseThread, 0, eraseWorker, 0);
+}
+
+void thread_driverStop(void)
+{
+    while (thread_driverIsBusy())
+        sleepUs(100);
+
+    pthread_mutex_lock(&driverMutex);
+    running = 0;
+    pthread_cond_signal(&eraseCond);
+    pthread_mutex_unlock(&driverMutex);
+
+    pthread_join(eraseThread, 0);
+}
+
+void thread_driverGetStats(thread_driverStats_t* pstats)
+{
+    pthread_mutex_lock(&driverMutex);
+    *pstats = driverStats;
+    pthread_mutex_unlock(&driverMutex);
+}
+
+void thread_driverWrite(unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    driverEnter(0);
+    nor_simWrite(flashAddr, buf, num);
+    driverLeave();
+}
+
+void thread_driverRead(unsigned int flashAddr, unsigned char* buf, unsigned short num)
+{
+    driverEnter(0);
+    nor_simRead(flashAddr, buf, num);
+    driverLeave();
+}
+
+void thread_driverEraseSector(unsigned int flashAddr)
+{
+    driverEnter(0);
+    nor_simEraseSector(flashAddr);
+    driverStats.syncErases++;
+    driverLeave();
+}
+
+void thread_driverEraseSectorStart(unsigned int flashAddr)
+{
+    driverEnter(1);
+
+    /* 上一次擦除还没有完成时库不应该启动新的擦除 */
+    if (eraseBusy)
+        driverStats.busyAccesses++;
+
+    eraseAddr = flashAddr;
+    __atomic_store_n(&eraseBusy, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&eraseCond);
+
+    driverLeave();
+}
+
+unsigned char thread_driverIsBusy(void)
+{
+    return (unsigned char)__atomic_load_n(&eraseBusy, __ATOMIC_ACQUIRE);
+}
+
+void thread_driverWriteLock(void)
+{
+    pthread_mutex_lock(&writeMutex);
+}
+
+void thread_driverWriteUnlock(void)
+{
+    pthread_mutex_unlock(&writeMutex);
+}
+
+void thread_driverYield(void)
+{
+    sched_yield();
+}
@@ -0,0 +1,62 @@
+/**
+ * @file thread_driver.h
+ * @brief 在模拟flash外面加一层用线程实现的驱动函数：所有访问通过一把互斥锁串行进行，
+ *        异步擦除交给工作线程，经过真实的等待时间后才完成；同时提供EE_USE_LOCK使用的写锁
+ * @note  编译时加上-DEE_TEST_DRIVER_FILE=\"thread_driver.h\"，库中的驱动函数名映射到这里的函数
+ */
+
+#ifndef __THREAD_DRIVER_H_
+#define __THREAD_DRIVER_H_
+
+#define ee_flashWrite        thread_driverWrite
+#define ee_flashRead         thread_driverRead
+#define ee_flashEraseASector thread_driverEraseSector
+
+#define ee_flashEraseASectorStart thread_driverEraseSectorStart
+#define ee_flashIsBusy            thread_driverIsBusy
+
+/* 开启EE_USE_LOCK时的写锁，读等待时让出CPU */
+#define ee_writeLock        thread_driverWriteLock
+#define ee_writeUnlock      thread_driverWriteUnlock
+#define ee_readYield()      thread_driverYield()
+#define ee_memoryBarrier()  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* 统计 */
+typedef struct
+{
+    /* 工作线程完成的异步擦除次数 */
+    unsigned long asyncErases;
+    /* 同步擦除的次数(模拟flash立即完成) */
+    unsigned long syncErases;
+    /* 擦除进行期间访问flash的次数，库应该先等待擦除完成，正确时为0 */
+    unsigned long busyAccesses;
+    /* 一个线程调用驱动函数时另一个线程已经在驱动函数中的次数(由驱动中的锁串行执行) */
+    unsigned long overlaps;
+} thread_driverStats_t;
+
+/**
+ * @brief         启动工作线程
+ *
+ * @param eraseUs 异步擦除一个扇区的真实等待时间(单位:us)
+ */
+void thread_driverStart(unsigned int eraseUs);
+
+/**
+ * @brief 等待正在进行的擦除完成后停止工作线程
+ */
+void thread_driverStop(void);
+
+void thread_driverGetStats(thread_driverStats_t* pstats);
+
+/* 驱动函数 */
+void thread_driverWrite(unsigned int flashAddr, unsigned char* buf, unsigned short num);
+void thread_driverRead(unsigned int flashAddr, unsigned char* buf, unsigned short num);
+void thread_driverEraseSector(unsigned int flashAddr);
+void thread_driverEraseSectorStart(unsigned int flashAddr);
+unsigned char thread_driverIsBusy(void);
+
+void thread_driverWriteLock(void);
+void thread_driverWriteUnlock(void);
+void thread_driverYield(void);
+
+#endif /* __THREAD_DRIVER_H_ */
@@ -0,0 +1,183 @@
+/**
+ * @file xip_test.c
+ * @brief 直接访问测试：模拟flash映射为文件镜像，EE_XIP_BASE指向映射的内存，通过ee_getDataPointer()得到的指针直接读取
+ * @note  每次写入后检查每个数据的指针指向的内容与写入的值相同；同时保留一部分旧指针，
+ *        代数没有改变时旧指针指向的内容必须仍然是获取时的内容(旧数据在擦除前仍然可以读取)，代数改变后重新获取
+ *        用法: xip_test [写入次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emulateEEprom.h"
+
+#define XIP_INDEX_SECTORS 2
+#define XIP_DATA_SECTORS  8
+#define XIP_FLASH_SECTORS (2 * XIP_INDEX_SECTORS + 2 * XIP_DATA_SECTORS)
+#define XIP_MAX_SIZE      200
+#define XIP_IMAGE         "build/xip_image.bin"
+
+/* 测试保留的旧指针 */
+typedef struct
+{
+    const unsigned char* pdata;
+    ee_size_t size;
+    ee_uint32 generation;
+    unsigned char copy[XIP_MAX_SIZE];
+} held_t;
+
+static ee_flash_t fm;
+static unsigned int randomState = 1;
+static unsigned char values[DATA_NUM][XIP_MAX_SIZE];
+static int valueSizes[DATA_NUM];
+static held_t held[DATA_NUM];
+static unsigned long pointerReads, compressedReads, heldChecks, refetches;
+
+static unsigned int nextRandom(void)
+{
+    randomState = randomState * 1103515245 + 12345;
+
+    return (randomState >> 8) & 0xFFFFFF;
+}
+
+static void mount(void)
+{
+    ee_flashInit(&fm, SECTORS(0), SECTORS(XIP_INDEX_SECTORS), XIP_INDEX_SECTORS, 1,
+                 SECTORS(2 * XIP_INDEX_SECTORS), SECTORS(2 * XIP_INDEX_SECTORS + XIP_DATA_SECTORS), XIP_DATA_SECTORS);
+}
+
+static void fail(const char* what, int id)
+{
+    printf("FAIL: id %d: %s\n", id, what);
+    exit(1);
+}
+
+/**
+ * @brief: 通过指针检查一个数据，压缩保存的数据通过ee_readDataFromFlash()检查
+ */
+static void checkPointer(int id)
+{
+    const void* pdata = 0;
+    ee_size_t size = 0;
+    ee_uint32 generation = ee_getGeneration(&fm);
+    ee_uint8 ret = ee_getDataPointer(&fm, (variableLists)id, &pdata, &size);
+
+    if (valueSizes[id] == 0)
+    {
+        if (ret != 2)
+            fail("got a pointer to data that was never written", id);
+        return;
+    }
+
+#if EE_USE_COMPRESS
+    if (ret == 4)
+    {
+        unsigned char buf[XIP_MAX_SIZE];
+
+        if (ee_readDataFromFlash(&fm, buf, (variableLists)id) || memcmp(buf, values[id], valueSizes[id]))
+            fail("wrong compressed value", id);
+        compressedReads++;
+        return;
+    }
+#endif
+
+    if (ret != 0)
+        fail("ee_getDataPointer() failed", id);
+
+    if ((size != (ee_size_t)valueSizes[id]) || memcmp(pdata, values[id], size))
+        fail("pointer does not point to the latest value", id);
+
+    /* 指针指向映射的flash镜像，不是RAM中的拷贝 */
+    if (((const unsigned char*)pdata < nor_simMemory()) || ((const unsigned char*)pdata + size > nor_simMemory() + SECTORS(XIP_FLASH_SECTORS)))
+        fail("pointer is outside the flash image", id);
+
+    pointerReads++;
+
+    if (held[id].pdata == 0)
+    {
+        held[id].pdata = pdata;
+        held[id].size = size;
+        held[id].generation = generation;
+        memcpy(held[id].copy, pdata, size);
+    }
+}
+
+/**
+ * @brief: 检查保留的旧指针，代数没有改变时内容不变，改变后丢弃
+ */
+static void checkHeld(void)
+{
+    ee_uint32 generation = ee_getGeneration(&fm);
+    int id;
+
+    for (id = 0; id < DATA_NUM; id++)
+    {
+        if (held[id].pdata == 0)
+            continue;
+
+        if (held[id].generation != generation)
+        {
+            held[id].pdata = 0;
+            refetches++;
+            continue;
+        }
+
+        if (memcmp(held[id].pdata, held[id].copy, held[id].size))
+            fail("held pointer changed while the generation stayed the same", id);
+        heldChecks++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int n, i, id, writeNum = (argc > 1) ? atoi(argv[1]) : 3000;
+
+    nor_simInit(SECTORS(XIP_FLASH_SECTORS), XIP_IMAGE);
+    mount();
+
+    for (n = 0; n < writeNum; n++)
+    {
+        int size = 1 + nextRandom() % XIP_MAX_SIZE;
+
+        id = nextRandom() % DATA_NUM;
+        for (i = 0; i < size; i++)
+            values[id][i] = (unsigned char)nextRandom();
+
+        /* 一部分数据可以压缩 */
+        if (nextRandom() % 4 == 0)
+            memset(values[id], 0, size - size / 4);
+        valueSizes[id] = size;
+
+        if (ee_writeDataToFlash(&fm, values[id], (ee_size_t)size, (variableLists)id))
+            fail("write failed", id);
+
+#if EE_USE_INCREMENTAL_GC
+        ee_gcStep(&fm, 1);
+#endif
+
+        checkHeld();
+        for (id = 0; id < DATA_NUM; id++)
+            checkPointer(id);
+
+        /* 重新挂载后之前的指针都不再使用 */
+        if (nextRandom() % 200 == 0)
+        {
+            mount();
+            memset(held, 0, sizeof(held));
+        }
+    }
+
+    printf("xip: writes=%d pointer reads=%lu compressed reads=%lu held pointer checks=%lu refetches after erase=%lu\n",
+           writeNum, pointerReads, compressedReads, heldChecks, refetches);
+
+    if ((heldChecks == 0) || (refetches == 0))
+    {
+        printf("FAIL: held pointers were not checked across an erase\n");
+        return 1;
+    }
+
+    nor_simDeinit();
+    remove(XIP_IMAGE);
+
+    return 0;
+}